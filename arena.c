@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define TAM_BLOQUE (64 * 1024)
+#define ALINEACION 16
+
+typedef struct bloque_arena {
+    struct bloque_arena *anterior;
+    size_t usado;
+    size_t tam;
+    _Alignas(ALINEACION) unsigned char datos[];
+} bloque_arena;
+
+static _Thread_local bloque_arena* actual = NULL;    /* Una arena por hilo */
+
+static bloque_arena* nuevo_bloque(size_t minimo) {
+    size_t tam = minimo > TAM_BLOQUE ? minimo : TAM_BLOQUE;
+    bloque_arena* b = malloc(sizeof(bloque_arena) + tam);
+    if (!b) {
+        fprintf(stderr, "Error fatal: Sin memoria (arena)\n");
+        exit(1);
+    }
+    b->usado = 0;
+    b->tam = tam;
+    return b;
+}
+
+void* arena_reservar(size_t tam) {
+    tam = (tam + ALINEACION - 1) & ~(size_t)(ALINEACION - 1);
+
+    if (!actual || actual->usado + tam > actual->tam) {
+        bloque_arena* b = nuevo_bloque(tam);
+        if (actual && tam > TAM_BLOQUE) {
+            /* Petición grande: bloque propio, seguimos usando el actual */
+            b->anterior = actual->anterior;
+            actual->anterior = b;
+            b->usado = tam;
+            return b->datos;
+        }
+        b->anterior = actual;
+        actual = b;
+    }
+    void* p = actual->datos + actual->usado;
+    actual->usado += tam;
+    return p;
+}
+
+char* arena_strdup(const char* s) {
+    size_t n = strlen(s) + 1;
+    char* copia = arena_reservar(n);
+    memcpy(copia, s, n);
+    return copia;
+}
+
+void arena_liberar() {
+    while (actual) {
+        bloque_arena* b = actual;
+        actual = b->anterior;
+        free(b);
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Memoria de la compilación: reserva por incremento de puntero en bloques
+   grandes y se libera de una sola vez al terminar (arena_liberar). Para
+   todo lo que vive hasta el final: símbolos y sus nombres. */
+
+// Reserva 'tam' bytes alineados (no se liberan por separado)
+void* arena_reservar(size_t tam);
+
+// Copia una cadena dentro de la arena
+char* arena_strdup(const char* s);
+
+// Libera todos los bloques de la arena
+void arena_liberar();
+
+#endif
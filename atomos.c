@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "atomos.h"
+#include "arena.h"
+
+#define CUBOS_INICIALES 1024    /* Potencia de 2 */
+
+static _Thread_local atomo** cubos = NULL;    /* Una tabla por hilo (como la arena) */
+static _Thread_local unsigned num_cubos = 0;
+static _Thread_local unsigned num_atomos = 0;
+
+/* FNV-1a de 32 bits */
+static unsigned hash_texto(const char* texto, int longitud) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < longitud; i++) {
+        h ^= (unsigned char)texto[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static atomo** reservar_cubos(unsigned n) {
+    atomo** c = calloc(n, sizeof(atomo*));
+    if (!c) {
+        fprintf(stderr, "Error fatal: Sin memoria (tabla de identificadores)\n");
+        exit(1);
+    }
+    return c;
+}
+
+/* Dobla el número de cubos cuando hay más átomos que cubos */
+static void crecer() {
+    unsigned n = num_cubos * 2;
+    atomo** nuevos = reservar_cubos(n);
+    for (unsigned i = 0; i < num_cubos; i++) {
+        atomo* a = cubos[i];
+        while (a) {
+            atomo* sig = a->siguiente;
+            a->siguiente = nuevos[a->hash & (n - 1)];
+            nuevos[a->hash & (n - 1)] = a;
+            a = sig;
+        }
+    }
+    free(cubos);
+    cubos = nuevos;
+    num_cubos = n;
+}
+
+atomo* atomo_intern(const char* texto, int longitud) {
+    if (!cubos) {
+        num_cubos = CUBOS_INICIALES;
+        cubos = reservar_cubos(num_cubos);
+    }
+
+    unsigned h = hash_texto(texto, longitud);
+    for (atomo* a = cubos[h & (num_cubos - 1)]; a; a = a->siguiente) {
+        if (a->hash == h && a->longitud == longitud && memcmp(a->nombre, texto, longitud) == 0)
+            return a;
+    }
+
+    /* Primera aparición: se copia el lexema una sola vez */
+    char* nombre = arena_reservar(longitud + 1);
+    memcpy(nombre, texto, longitud);
+    nombre[longitud] = '\0';
+
+    atomo* a = arena_reservar(sizeof(atomo));
+    a->nombre = nombre;
+    a->hash = h;
+    a->longitud = longitud;
+    a->simbolo = NULL;
+    a->siguiente = cubos[h & (num_cubos - 1)];
+    cubos[h & (num_cubos - 1)] = a;
+
+    if (++num_atomos > num_cubos) crecer();
+    return a;
+}
+
+void atomos_liberar() {
+    free(cubos);
+    cubos = NULL;
+    num_cubos = num_atomos = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef ATOMOS_H
+#define ATOMOS_H
+
+#include "symtab.h"
+
+/* Tabla de identificadores internados. El scanner convierte cada lexema
+   T_ID en un átomo único: dos apariciones del mismo nombre devuelven el
+   mismo puntero, así que no hace falta copiar ni liberar lexemas. */
+
+typedef struct atomo {
+    const char *nombre;         // Copia única del lexema (en la arena)
+    unsigned hash;
+    int longitud;
+    info_simbolo *simbolo;      // Enlace con la symtab (NULL si aún no resuelto)
+    struct atomo *siguiente;    // Siguiente átomo del mismo cubo
+} atomo;
+
+// Devuelve el átomo del lexema (lo crea la primera vez que aparece)
+atomo* atomo_intern(const char* texto, int longitud);
+
+// Libera la tabla (los átomos viven en la arena)
+void atomos_liberar();
+
+#endif
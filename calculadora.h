@@ -0,0 +1,112 @@
+#ifndef CALCULADORA_H
+#define CALCULADORA_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "semantica.h"
+#include "optimizador.h"
+#include "estadisticas.h"
+#include "traza.h"
+
+/* Biblioteca del compilador (libcalculadora.a / libcalculadora.so): compila
+   un programa desde memoria o desde un fichero abierto y entrega la salida
+   y los errores a funciones de quien llama, sin ficheros temporales ni
+   procesos. El estado de la compilación es de cada hilo, así que se puede
+   compilar desde varios hilos a la vez, pero no empezar otra compilación
+   en el mismo hilo desde una de las funciones de cal_destino: se rechaza
+   con un error CAL_SISTEMA. El ejecutable calculadora (main.c)
+   es un cliente más de esta interfaz. */
+
+// Qué se entrega como salida
+typedef enum {
+    CAL_TEXTO,      // Listado C3A, como lo imprime calculadora
+    CAL_QUADS,      // Un registro 'quad' por instrucción, ya optimizados
+    CAL_EJECUTAR,   // Lo que imprime el programa en la máquina virtual (--run)
+    CAL_C           // El programa como fuente C (--emit-c)
+} cal_formato;
+
+typedef enum {
+    CAL_LEXICO,     // Carácter desconocido, comentario sin cerrar
+    CAL_SINTAXIS,
+    CAL_SEMANTICO,  // Variable no declarada...
+    CAL_EJECUCION,  // División por cero, índice fuera de rango... (CAL_EJECUTAR)
+    CAL_TRADUCCION, // Quad que la máquina virtual o la traducción a C no admiten
+    CAL_SISTEMA     // Fichero que no se puede abrir, programa demasiado grande...
+} cal_tipo_error;
+
+typedef struct {
+    cal_tipo_error tipo;
+    const char* nombre;     // El de cal_opciones (puede ser NULL)
+    int linea;              // Línea del fuente (0 en los de ejecución)
+    int quad;               // Quad que falla (en los de ejecución y traducción)
+    const char* mensaje;
+    const char* cerca;      // Texto del token cercano, o lo que falla (o NULL).
+                            // En los de sistema, la causa (strerror)
+} cal_diagnostico;
+
+// Pasadas, desenrollado, --stats y traza de una compilación
+typedef struct {
+    opciones_opt optimizacion;  // -O, --passes, --pass-stats, --unroll-*
+    formato_est estadisticas;   // --stats
+    opciones_traza traza;       // --trace, --log
+} cal_ajustes;
+
+// Opciones de una compilación. Con todo a cero: listado C3A sin nombre con
+// los ajustes por defecto.
+typedef struct {
+    cal_formato formato;
+    const char* nombre;         // Para los mensajes y la cabecera del listado (NULL: sin nombre)
+    int continua;               // CAL_TEXTO: imprime según se genera (--stream); se
+                                // ignora si hay pasadas sobre el programa completo
+    int perfilar;               // CAL_EJECUTAR: escribe el perfil de la ejecución
+    const char* fichero_perfil; // Dónde (NULL: stderr)
+    const char* fichero_log;    // Con la traza activa, dónde volcarla (NULL: stderr si hay un error)
+    const cal_ajustes* ajustes; // Solo para esta compilación (NULL: los de cal_opcion)
+} cal_opciones;
+
+// A dónde va el resultado. Las funciones que falten no se llaman.
+typedef struct {
+    FILE* salida;           // Si no es NULL, el texto se escribe aquí directamente
+    void* usuario;          // Se pasa tal cual a las funciones
+    // Texto de la salida (CAL_TEXTO, CAL_EJECUTAR, CAL_C) según se produce
+    void (*texto)(void* usuario, const char* datos, size_t longitud);
+    // CAL_QUADS: cada quad con su número (1..n). Los nombres de variables
+    // apuntan a memoria de la compilación: solo valen durante la llamada.
+    void (*quad)(void* usuario, int numero, const quad* q);
+    // Errores; sin esta función se escriben por stderr (cal_escribir_diagnostico)
+    void (*diagnostico)(void* usuario, const cal_diagnostico* d);
+} cal_destino;
+
+// Cambia 'a' con una opción con la sintaxis de la línea de comandos (-O2,
+// --passes=..., --unroll-*, --pass-stats, --stats, --trace, --log=...).
+// Devuelve 1 si la acepta, 0 si no es suya y -1 si el valor es erróneo
+// (con un mensaje por stderr).
+int cal_ajustar(cal_ajustes* a, const char* opcion);
+
+// Lo mismo sobre los ajustes por defecto, los de las compilaciones sin
+// cal_opciones.ajustes (los de la línea de comandos de calculadora). No se
+// deben cambiar mientras haya alguna compilación en marcha.
+int cal_opcion(const char* opcion);
+
+// Copia en 'a' los ajustes por defecto, para cambiarlos con cal_ajustar
+void cal_ajustes_iniciales(cal_ajustes* a);
+
+// Compila los 'longitud' bytes de 'fuente' (no hace falta el '\0' final).
+// Devuelve 0, o 1 si la compilación no ha podido terminar (comentario sin
+// cerrar, error de ejecución, programa con errores en CAL_EJECUTAR/CAL_C,
+// fichero que no se puede abrir, llamada desde una función de cal_destino
+// de otra compilación del mismo hilo). Todos los errores, también los que hacen
+// fallar la compilación, llegan como diagnósticos.
+int cal_compilar_buffer(const char* fuente, size_t longitud,
+                        const cal_opciones* opciones, const cal_destino* destino);
+
+// Lo mismo leyendo de un fichero ya abierto, desde su posición actual. Un
+// fichero regular se proyecta en memoria y se escanea en sitio (no debe
+// truncarse mientras tanto); una tubería o un terminal se leen por bloques.
+// Al terminar el fichero queda al final.
+int cal_compilar_fichero(FILE* entrada, const cal_opciones* opciones, const cal_destino* destino);
+
+// Escribe un diagnóstico con el formato de calculadora ("Error [Linea 3]: ...")
+void cal_escribir_diagnostico(FILE* out, const cal_diagnostico* d);
+
+#endif
@@ -1,31 +1,91 @@
 %{
+#define _GNU_SOURCE     /* fopencookie: la salida de texto va a una función */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "calculadora.h"
 #include "semantica.h" 
 #include "symtab.h"
-
-extern int yylex();
-extern int lineno;
-extern char *yytext;
-void yyerror(const char *s);
-FILE *logfile;
-
-void log_regla(const char *mensaje) {
-    if (logfile) fprintf(logfile, "Regla: %s\n", mensaje);
-}
+#include "arena.h"
+#include "optimizador.h"
+#include "vm.h"
+#include "generador_c.h"
+#include "perfil.h"
+#include "estadisticas.h"
+#include "traza.h"
+
+/* Solo se registra con --trace o --log (ver traza.h) */
+#define log_regla(mensaje) TRAZA(TRAZA_REGLAS, linea_token, mensaje, 0, 0)
+
+/* Con %locations cada reducción pasa por YYLLOC_DEFAULT: se cuentan ahí.
+   De las posiciones solo se usa la línea del token (linea_token). */
+#define YYLLOC_DEFAULT(Actual, Rhs, N) \
+    do { EST_CONTAR(EST_REDUCCIONES); (Actual) = YYRHSLOC(Rhs, (N) ? 1 : 0); } while (0)
 %}
 
+%locations
+%define api.pure full
+%param {yyscan_t escaner}
+
 %code requires {
     #include "semantica.h"
     #include "symtab.h"
+    #include "atomos.h"
+    #include "calculadora.h"
+
+    #ifndef YY_TYPEDEF_YY_SCANNER_T
+    #define YY_TYPEDEF_YY_SCANNER_T
+    typedef void* yyscan_t;
+    #endif
+
+    /* Una compilación en curso. El escáner (reentrante) la lleva en yyextra
+       y el parser (puro) recibe el escáner como parámetro: no hay estado
+       global, y cada hilo puede compilar su propio fichero. */
+    typedef struct {
+        const cal_opciones* opciones;
+        const cal_ajustes* ajustes;     // Los de las opciones o los por defecto
+        const cal_destino* destino;     // También recibe los errores
+        yyscan_t escaner;
+        int errores;            // Errores de sintaxis y semánticos (con alguno no se ejecuta)
+        int abortada;           // El léxico no ha podido seguir (comentario sin cerrar)
+        int eof_devuelto;       // Ya se ha devuelto el T_EOL del final
+        double ms_lexico;       // Tiempo dentro del escáner (--stats)
+    } compilacion;
+}
+
+%code provides {
+    // Entrega un error al destino de la compilación ('cerca' puede ser NULL)
+    void error_compilacion(const compilacion* c, cal_tipo_error tipo, int linea,
+                           const char* mensaje, const char* cerca);
+}
+
+%code {
+    /* El escáner de flex (YY_DECL y %option reentrant en calculadora.l) */
+    int lex_siguiente(YYSTYPE* valor, YYLTYPE* pos, yyscan_t escaner);
+    int yylex_init_extra(compilacion* extra, yyscan_t* escaner);
+    int yylex_destroy(yyscan_t escaner);
+    void yyset_in(FILE* entrada, yyscan_t escaner);
+    struct yy_buffer_state* yy_scan_bytes(const char* bytes, int longitud, yyscan_t escaner);
+    struct yy_buffer_state* yy_scan_buffer(char* base, size_t longitud, yyscan_t escaner);
+    void yyset_lineno(int linea, yyscan_t escaner);
+    compilacion* yyget_extra(yyscan_t escaner);
+    char* yyget_text(yyscan_t escaner);
+    int yyget_lineno(yyscan_t escaner);
+
+    int yylex(YYSTYPE* valor, YYLTYPE* pos, yyscan_t escaner);
+    void yyerror(YYLTYPE* pos, yyscan_t escaner, const char* s);
 }
 
 /* --- UNION --- */
 %union {
     atributos atris;    /* Estructura para símbolos y listas de saltos */
-    char* texto;        /* Identificadores */
+    cabecera_for cab_for; /* Cabecera del for ya emitida */
+    atomo* id;          /* Identificadores (internados por el scanner) */
     int ival;           /* Enteros */
     float fval;         /* Reales */
 }
@@ -53,15 +113,13 @@ void log_regla(const char *mensaje) {
 /* Tokens con valor */
 %token <ival> T_LIT_ENTERO
 %token <fval> T_LIT_REAL
-%token <texto> T_ID
+%token <id> T_ID
 
 /* --- TIPOS DE RETORNO --- */
 %type <atris> expresion termino potencia factor base
 %type <atris> condicion M N
 %type <atris> cond_or cond_and cond_not cond_rel
-%type <atris> for_header
-%type <atris> lista_casos caso default_caso
-%type <atris> inicio_caso
+%type <cab_for> for_header
 
 %type <ival> tipo declaracion
 
@@ -81,9 +139,11 @@ seccion_opciones:
     | /* vacío */
     ;
 
+/* Entre sentencias todos los saltos pendientes están en listas: con
+   --stream se imprime lo que ya no puede cambiar */
 lista_sentencias:
-      sentencia
-    | lista_sentencias sentencia
+      sentencia                     { sem_volcar_terminados(); }
+    | lista_sentencias sentencia    { sem_volcar_terminados(); }
     ;
 
 sentencia:
@@ -93,14 +153,12 @@ sentencia:
     | T_ID T_ASSIGN expresion T_EOL {
         log_regla("Sentencia: Asignacion");
         sem_asignar($1, $3); 
-        free($1);
     }
 
     /* 2. Asignación a Array */
     | T_ID T_LBRACKET expresion T_RBRACKET T_ASSIGN expresion T_EOL {
         log_regla("Sentencia: Asignacion Array");
         sem_asignar_array($1, $3, $6);
-        free($1);
     }
 
     /* 3. Impresión */
@@ -116,65 +174,23 @@ sentencia:
 
 /* 5. REPEAT con OPTIMIZACIÓN (Loop Unrolling) */
     | T_REPEAT expresion T_DO { 
-        /* 1. ANTES del cuerpo: Empezamos a grabar */
-        sem_start_record(); 
+        /* 1. ANTES del cuerpo: capa de break y marca del inicio del cuerpo */
+        sem_init_break_layer();
+        $<ival>$ = sem_start_record(); 
       } 
       T_EOL lista_sentencias T_DONE T_EOL {
         log_regla("Sentencia: Repeat Optimizado");
         
-        /* 2. DESPUÉS del cuerpo: Paramos y recuperamos el texto */
-        char* cuerpo = sem_stop_record();
-        
-        /* 3. Análisis: ¿Es un literal entero pequeño (<= 5)? */
-        int es_literal = 0;
-        int repeticiones = 0;
+        /* 2. DESPUÉS del cuerpo: lo recuperamos (sale del buffer) */
+        bloque_quads cuerpo = sem_stop_record($<ival>4);
         
-        /* Si el nombre del símbolo empieza por dígito, es un literal */
-        if (isdigit($2.simb->nombre[0])) {
-             es_literal = 1;
-             repeticiones = atoi($2.simb->nombre);
-        }
+        /* 3. Desenrollado completo, parcial o bucle estándar según el número
+              de repeticiones y los umbrales de sem_opciones */
+        int etiqueta_salida = sem_generar_repeat(cuerpo, $2);
+        sem_liberar_bloque(cuerpo);
 
-        /* --- CAMINO A: OPTIMIZACIÓN (Unrolling) --- */
-        if (es_literal && repeticiones > 0 && repeticiones <= 5) {
-             // pegamos el código N veces
-             for (int k = 0; k < repeticiones; k++) {
-                 sem_emitir_bloque(cuerpo);
-             }
-        } 
-        /* --- CAMINO B: BUCLE ESTÁNDAR (Dinámico) --- */
-        else {
-             
-             // 1. Crear contador temporal y asignar 0
-             atributos contador = sem_crear_temporal(T_ENTERO);
-             atributos cero = sem_crear_literal("0", T_ENTERO);
-             sem_asignar(contador.simb->nombre, cero);
-             
-             // 2. Etiqueta de inicio del bucle
-             int etiqueta_inicio = sem_generar_etiqueta();
-             
-             // 3. Condición de salida: contador < expresion
-             atributos cond = sem_operar_relacional(contador, $2, "LT");
-             
-             // 4. Si la condición es FALSA, saltar al final (Exit)
-             int etiqueta_cuerpo = sem_generar_etiqueta();
-             sem_backpatch(cond.truelist, etiqueta_cuerpo); // Si TRUE, entra al cuerpo
-             
-             // 5. Inyectar el cuerpo grabado
-             sem_emitir_bloque(cuerpo);
-             
-             // 6. Incrementar contador: contador := contador + 1
-             atributos uno = sem_crear_literal("1", T_ENTERO);
-             atributos suma = sem_operar_binario(contador, uno, "ADDI", "ADDF");
-             sem_asignar(contador.simb->nombre, suma);
-             
-             // 7. Saltar al inicio para comprobar condición
-             sem_emitir("GOTO %d", etiqueta_inicio);
-             
-             // 8. Etiqueta final (Backpatching del False)
-             sem_backpatch(cond.falselist, sem_generar_etiqueta());
-        }
-        free(cuerpo);
+        /* mandamos los breaks a la salida */
+        sem_close_break_layer(etiqueta_salida);
     }
 
     /* 6. IF-THEN */
@@ -207,7 +223,7 @@ sentencia:
         sem_backpatch($3.truelist, $5.quad);
 
         /* 1. Primero emitimos el salto para volver arriba */
-        sem_emitir("GOTO %d", $2.quad);
+        sem_emitir_salto($2.quad);
 
         /* 2. Generamos la etiqueta de salida (sig_instruccion libre) */
         /* y rellenamos los saltos falsos para que vengan aquí. */
@@ -240,48 +256,37 @@ sentencia:
     }
 
     /* 10. FOR: Usa la cabecera auxiliar */
-    | for_header T_EOL { sem_init_break_layer(); } lista_sentencias T_DONE T_EOL {
+    | for_header T_EOL {
+        sem_init_break_layer();
+        sem_abrir_region($1.etiqueta_inicio);  /* El desenrollado rehace la cabecera */
+        $<ival>$ = sem_start_record();
+      } lista_sentencias T_DONE T_EOL {
         log_regla("Sentencia: FOR");
         
-        /* Recuperamos la información de la cabecera ($1) */
-        info_simbolo* iterador = $1.simb;
-        int etiqueta_inicio = $1.quad;
-        lista_nodos* salida = $1.falselist;
-        
-        /* 5. Incremento Automático: iterador := iterador + 1 */
-        /* Reconstruimos atributos para poder usar sem_operar_binario */
-        atributos at_iter; at_iter.simb = iterador;
-        atributos at_uno = sem_crear_literal("1", T_ENTERO);
-        
-        /* Generamos la suma */
-        atributos suma = sem_operar_binario(at_iter, at_uno, "ADDI", "ADDF");
-        
-        /* Asignamos el resultado a la variable iteradora */
-        sem_asignar(iterador->nombre, suma);
-        
-        /* 6. Volver al inicio (Check condición) */
-        sem_emitir("GOTO %d", etiqueta_inicio);
-        
-        /* 7. Rellenar la salida (Backpatching del False de la condición) */
-        int etiqueta_salida = sem_generar_etiqueta();
-        sem_backpatch(salida, etiqueta_salida);
+        /* Incremento, vuelta a la comprobación y salida (desenrollando el
+           cuerpo si los límites lo permiten) */
+        int etiqueta_salida = sem_generar_for($1, $<ival>3);
 
         /* mandamoslos breaks a la salida */
         sem_close_break_layer(etiqueta_salida);
     }
 
     /* 11. SWITCH */
-    | T_SWITCH expresion T_LBRACE T_EOL { sem_push_switch($2.simb->nombre); } 
+    | T_SWITCH expresion T_LBRACE T_EOL {
+        /* Capa de break propia: un break dentro de un caso sale del switch */
+        sem_init_break_layer();
+        sem_push_switch($2);
+      }
       lista_casos 
       T_RBRACE T_EOL {
         log_regla("Sentencia: SWITCH");
+
+        /* Código que elige el caso (tabla de saltos, búsqueda binaria o
+           comparaciones) y detrás los cuerpos */
+        int etiqueta_salida = sem_generar_switch();
         sem_pop_switch();
-        
-        /* Backpatching de la salida */
-        int etiqueta_salida = sem_generar_etiqueta();
-        sem_backpatch($6.nextlist, etiqueta_salida);
 
-        /* mandamoslos breaks a la salida */
+        /* mandamoslos breaks a la salida (incluido el final de cada caso) */
         sem_close_break_layer(etiqueta_salida);
     }
 
@@ -295,58 +300,38 @@ sentencia:
     ;
 
 /* lista_casos: Gestiona la recursividad de 'case ... case ... default' */
-/* Devolvemos una lista de 'salidas' (breaks) para rellenar al final del switch */
+/* Cada caso apunta dónde empieza su cuerpo; el despacho se genera al final */
 
 lista_casos:
-    caso lista_casos { 
-          /* Fusionamos las listas de break de este caso con los siguientes */
-          atributos res;
-          res.nextlist = sem_merge($1.nextlist, $2.nextlist);
-          $$ = res;
-    }
-    | default_caso { $$ = $1; }
-    | /* vacío */ { 
-        atributos a; a.nextlist = NULL; $$ = a; 
-    }
+      casos default_caso
+    | casos
+    | default_caso
+    | /* vacío */
     ;
 
-/* Regla auxiliar: Genera el IF *antes* de procesar el cuerpo */
+/* Recursiva por la izquierda: la pila del parser no crece con el número de casos */
+casos:
+      casos caso
+    | caso
+    ;
+
+/* Regla auxiliar: marca el inicio del cuerpo *antes* de procesarlo */
 inicio_caso:
     T_CASE T_LIT_ENTERO T_COLON T_EOL {
-        char* var_switch = sem_get_switch_var();
-        char num[20]; sprintf(num, "%d", $2);
-        
-        /* 1. Emitimos la comprobación: IF var != num GOTO [siguiente] */
-        int instr_check = sem_emitir("IF %s NE %s GOTO", var_switch, num);
-        
-        /* Devolvemos la lista con este salto pendiente para rellenarlo luego */
-        atributos res;
-        res.truelist = sem_makelist(instr_check); 
-        $$ = res;
+        sem_anyadir_caso($2);
     }
     ;
 
 caso:
     inicio_caso lista_sentencias {
-        /* $1 contiene el salto del IF pendiente */
-        
-        /* 2. Terminamos el cuerpo con un salto al FINAL del switch */
-        int instr_salida = sem_emitir("GOTO");
-        
-        /* 3. Ahora que hemos acabado el cuerpo, sabemos dónde empieza el siguiente caso.
-              Hacemos Backpatch del IF ($1) para que salte AQUÍ si la condición falló. */
-        sem_backpatch($1.truelist, sem_generar_etiqueta());
-        
-        atributos res;
-        res.nextlist = sem_makelist(instr_salida);
-        $$ = res;
+        /* Terminamos el cuerpo con un salto al FINAL del switch */
+        sem_add_break();
     }
     ;
 
 default_caso:
-    T_DEFAULT T_COLON T_EOL lista_sentencias {
-        /* No genera salidas pendientes (cae al final) */
-        atributos res; res.nextlist = NULL; $$ = res;
+    T_DEFAULT T_COLON T_EOL { sem_anyadir_default(); } lista_sentencias {
+        /* Es el último: cae directamente a la salida */
     }
     ;
 
@@ -356,17 +341,17 @@ default_caso:
 M: /* vacío */ { 
     atributos a;
     a.quad = sem_generar_etiqueta();
-    a.simb = NULL; a.truelist = NULL; a.falselist = NULL; a.nextlist = NULL;
+    a.dir = sem_opnd_nulo(); a.truelist = NULL; a.falselist = NULL; a.nextlist = NULL;
     $$ = a;
 }
 ;
 
 /* Marcador N: Genera GOTO y guarda posición */
 N: /* vacío */ {
-    int instr = sem_emitir("GOTO");
+    int instr = sem_emitir_salto(0);
     atributos a;
     a.nextlist = sem_makelist(instr);
-    a.simb = NULL; a.truelist = NULL; a.falselist = NULL; a.quad = 0;
+    a.dir = sem_opnd_nulo(); a.truelist = NULL; a.falselist = NULL; a.quad = 0;
     $$ = a;
 }
 ;
@@ -385,7 +370,7 @@ for_header:
         atributos id_atrs = sem_obtener_simbolo($2);
         
         /* Generamos la comparación LE (Less or Equal) */
-        atributos cond = sem_operar_relacional(id_atrs, $6, "LE");
+        atributos cond = sem_operar_relacional(id_atrs, $6, REL_LE);
         
         /* 4. Gestión de Saltos */
         /* TRUE: Si es menor o igual, entra al cuerpo (siguiente instrucción) */
@@ -394,10 +379,12 @@ for_header:
         /* FALSE: Si es mayor, debe salir. Guardamos esta lista para el final. */
         
         /* Empaquetamos todo para devolverlo a la regla principal */
-        atributos res;
-        res.quad = etiqueta_inicio;      // Para el GOTO de vuelta
-        res.falselist = cond.falselist;  // Para el GOTO de salida
-        res.simb = id_atrs.simb;         // Guardamos el puntero al ID para incrementarlo luego
+        cabecera_for res;
+        res.etiqueta_inicio = etiqueta_inicio;  // Para el GOTO de vuelta
+        res.salida = cond.falselist;            // Para el GOTO de salida
+        res.iterador = id_atrs.dir;             // Guardamos el ID para incrementarlo luego
+        res.inicio = $4.dir;                    // Límites (para desenrollar)
+        res.fin = $6.dir;
         
         $$ = res;
     }
@@ -468,22 +455,22 @@ cond_not:
     ;
 
 cond_rel:
-      expresion T_EQ expresion { $$ = sem_operar_relacional($1, $3, "EQ"); }
-    | expresion T_NE expresion { $$ = sem_operar_relacional($1, $3, "NE"); }
-    | expresion T_LT expresion { $$ = sem_operar_relacional($1, $3, "LT"); }
-    | expresion T_LE expresion { $$ = sem_operar_relacional($1, $3, "LE"); }
-    | expresion T_GT expresion { $$ = sem_operar_relacional($1, $3, "GT"); }
-    | expresion T_GE expresion { $$ = sem_operar_relacional($1, $3, "GE"); }
+      expresion T_EQ expresion { $$ = sem_operar_relacional($1, $3, REL_EQ); }
+    | expresion T_NE expresion { $$ = sem_operar_relacional($1, $3, REL_NE); }
+    | expresion T_LT expresion { $$ = sem_operar_relacional($1, $3, REL_LT); }
+    | expresion T_LE expresion { $$ = sem_operar_relacional($1, $3, REL_LE); }
+    | expresion T_GT expresion { $$ = sem_operar_relacional($1, $3, REL_GT); }
+    | expresion T_GE expresion { $$ = sem_operar_relacional($1, $3, REL_GE); }
     | T_TRUE { 
         atributos res; 
-        int instr = sem_emitir("GOTO"); 
+        int instr = sem_emitir_salto(0); 
         res.truelist = sem_makelist(instr); 
         res.falselist = NULL; 
         $$ = res; 
     }
     | T_FALSE { 
         atributos res; 
-        int instr = sem_emitir("GOTO"); 
+        int instr = sem_emitir_salto(0); 
         res.falselist = sem_makelist(instr); 
         res.truelist = NULL; 
         $$ = res; 
@@ -493,11 +480,11 @@ cond_rel:
 expresion:
       expresion T_MAS termino   { 
           log_regla("Operacion: Suma (+)");
-          $$ = sem_operar_binario($1, $3, "ADDI", "ADDF"); 
+          $$ = sem_operar_binario($1, $3, OP_ADDI, OP_ADDF); 
       }
     | expresion T_MENOS termino { 
           log_regla("Operacion: Resta (-)");
-          $$ = sem_operar_binario($1, $3, "SUBI", "SUBF"); 
+          $$ = sem_operar_binario($1, $3, OP_SUBI, OP_SUBF); 
       }
     | termino { $$ = $1; }
     ;
@@ -505,15 +492,15 @@ expresion:
 termino:
       termino T_POR potencia { 
           log_regla("Operacion: Mult (*)");
-          $$ = sem_operar_binario($1, $3, "MULI", "MULF"); 
+          $$ = sem_operar_binario($1, $3, OP_MULI, OP_MULF); 
       }
     | termino T_DIV potencia { 
           log_regla("Operacion: Div (/)");
-          $$ = sem_operar_binario($1, $3, "DIVI", "DIVF"); 
+          $$ = sem_operar_binario($1, $3, OP_DIVI, OP_DIVF); 
       }
     | termino T_MOD potencia { 
           log_regla("Operacion: Mod (%)");
-          $$ = sem_operar_binario($1, $3, "MODI", "MODI"); 
+          $$ = sem_operar_binario($1, $3, OP_MODI, OP_MODI); 
       }
     | potencia { $$ = $1; }
     ;
@@ -521,70 +508,358 @@ termino:
 potencia:
       factor T_POW potencia { 
           log_regla("Operacion: Pow (**)");
-          $$ = sem_operar_binario($1, $3, "POW", "POW"); 
+          $$ = sem_operar_binario($1, $3, OP_POW, OP_POW); 
       }
     | factor { $$ = $1; }
     ;
 
 factor:
       T_MENOS factor { 
-          char* temp = sem_generar_temporal();
-          if ($2.simb->tipo == T_REAL)
-             sem_emitir("%s := CHSF %s", temp, $2.simb->nombre);
-          else
-             sem_emitir("%s := CHSI %s", temp, $2.simb->nombre);
-          
-          $$ = sem_crear_literal(temp, $2.simb->tipo);
+          $$ = sem_cambiar_signo($2);
       }
     | T_MAS factor   { $$ = $2; }
     | base           { $$ = $1; }
     ;
 
 base:
-      T_LIT_REAL   { 
-          char buf[64];
-          sprintf(buf, "%.6g", $1);
-          $$ = sem_crear_literal(buf, T_REAL); 
-      }
-    | T_LIT_ENTERO { 
-          char buf[64]; sprintf(buf, "%d", $1);
-          $$ = sem_crear_literal(buf, T_ENTERO); 
-      }
+      T_LIT_REAL   { $$ = sem_crear_real($1); }
+    | T_LIT_ENTERO { $$ = sem_crear_entero($1); }
     | T_LPAREN expresion T_RPAREN { $$ = $2; }
     | T_ID {
         $$ = sem_obtener_simbolo($1);
-        free($1);
     }
     | T_ID T_LBRACKET expresion T_RBRACKET {
         $$ = sem_acceder_array($1, $3); 
-        free($1);
     }
     ;
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Error [Linea %d]: %s cerca de '%s'\n", lineno, s, yytext);
-    if (logfile) fprintf(logfile, "ERROR [Linea %d]: %s (Token: %s)\n", lineno, s, yytext);
+/* --- ERRORES --- */
+
+/* Compilación del hilo: para los errores que vienen de semantica.c y vm.c */
+static _Thread_local compilacion* actual = NULL;
+
+void cal_escribir_diagnostico(FILE* out, const cal_diagnostico* d) {
+    flockfile(out);     /* Los mensajes de varios hilos no se mezclan */
+    switch (d->tipo) {
+        case CAL_LEXICO:
+            fprintf(out, "Error Léxico: %s", d->mensaje);
+            if (d->cerca) fprintf(out, " '%s'", d->cerca);
+            fprintf(out, " en línea %d\n", d->linea);
+            break;
+        case CAL_EJECUCION:
+            fprintf(out, "Error de ejecución [quad %d]: %s\n", d->quad, d->mensaje);
+            break;
+        case CAL_TRADUCCION:
+            fprintf(out, "Error: %s", d->mensaje);
+            if (d->cerca) fprintf(out, " '%s'", d->cerca);
+            fprintf(out, " en el quad %d\n", d->quad);
+            break;
+        case CAL_SISTEMA:
+            fprintf(out, "Error: %s", d->mensaje);
+            if (d->cerca) fprintf(out, ": %s", d->cerca);
+            fputc('\n', out);
+            break;
+        default:
+            fprintf(out, "Error [Linea %d]: %s", d->linea, d->mensaje);
+            if (d->cerca) fprintf(out, " cerca de '%s'", d->cerca);
+            fputc('\n', out);
+            break;
+    }
+    funlockfile(out);
 }
 
-int main(int argc, char *argv[]) {
-    extern FILE *yyin;
-    logfile = fopen("calculadora.log", "w");
-    if (!logfile) { fprintf(stderr, "Error log\n"); return 1; }
-    
-    if (argc > 1) {
-        yyin = fopen(argv[1], "r");
-        if (!yyin) { perror("Error fichero"); return 1; }
-        printf("Generando C3A para: %s\n", argv[1]);
+static void informar(const compilacion* c, const cal_diagnostico* d) {
+    if (c->destino->diagnostico) c->destino->diagnostico(c->destino->usuario, d);
+    else cal_escribir_diagnostico(stderr, d);
+}
+
+void error_compilacion(const compilacion* c, cal_tipo_error tipo, int linea,
+                       const char* mensaje, const char* cerca) {
+    cal_diagnostico d = { tipo, c->opciones->nombre, linea, 0, mensaje, cerca };
+    informar(c, &d);
+}
+
+void yyerror(YYLTYPE* pos, yyscan_t escaner, const char* s) {
+    compilacion* c = yyget_extra(escaner);
+    int linea = yyget_lineno(escaner);
+    (void)pos;
+    c->errores++;
+    error_compilacion(c, CAL_SINTAXIS, linea, s, yyget_text(escaner));
+    traza_error(linea, s, c->errores);
+}
+
+void sem_error(const char* s) {
+    /* Muchas reglas se reducen con el fin de línea ya leído: la línea es la
+       de ese token (yylineno ya va por la siguiente) y no se cita */
+    int linea = linea_token;
+    const char* cerca = yyget_text(actual->escaner);
+    actual->errores++;
+    error_compilacion(actual, CAL_SEMANTICO, linea, s, *cerca == '\n' ? NULL : cerca);
+    traza_error(linea, s, actual->errores);
+}
+
+void vm_error(int quad, const char* texto) {
+    cal_diagnostico d = { CAL_EJECUCION, actual->opciones->nombre, 0, quad, texto, NULL };
+    informar(actual, &d);
+    traza_error(0, texto, quad);
+}
+
+void sem_error_quad(int quad, const char* s, const char* cerca) {
+    cal_diagnostico d = { CAL_TRADUCCION, actual->opciones->nombre, 0, quad, s, cerca };
+    informar(actual, &d);
+    traza_error(0, s, quad);
+}
+
+/* Lo que ha fallado y la causa (errno), como perror */
+static void error_sistema(const compilacion* c, const char* mensaje) {
+    error_compilacion(c, CAL_SISTEMA, 0, mensaje, strerror(errno));
+}
+
+/* El parser lee los tokens a través de aquí para que --stats los cuente y
+   separe el tiempo del léxico del de las acciones semánticas */
+int yylex(YYSTYPE* valor, YYLTYPE* pos, yyscan_t escaner) {
+    int token;
+    EST_CONTAR(EST_TOKENS);
+    if (!est_activas()) {
+        token = lex_siguiente(valor, pos, escaner);
+    } else {
+        /* Solo el reloj real: el de CPU es una llamada al sistema y por token
+           costaría más que el propio léxico */
+        double t0 = est_reloj_real();
+        token = lex_siguiente(valor, pos, escaner);
+        yyget_extra(escaner)->ms_lexico += est_reloj_real() - t0;
     }
+    linea_token = pos->first_line;
+    return token;
+}
+
+/* --- COMPILACIÓN --- */
+
+/* Los de la línea de comandos: se leen (se copian al thread-local de cada
+   módulo en preparar) pero no se escriben mientras se compila */
+static cal_ajustes ajustes_por_defecto = { .optimizacion = OPT_OPCIONES_POR_DEFECTO };
+
+int cal_ajustar(cal_ajustes* a, const char* opcion) {
+    int r = opt_procesar_opcion(&a->optimizacion, opcion);
+    if (r == 0) r = est_procesar_opcion(&a->estadisticas, opcion);
+    if (r == 0) r = traza_procesar_opcion(&a->traza, opcion);
+    return r;
+}
+
+int cal_opcion(const char* opcion) {
+    return cal_ajustar(&ajustes_por_defecto, opcion);
+}
+
+void cal_ajustes_iniciales(cal_ajustes* a) {
+    *a = ajustes_por_defecto;
+}
+
+/* Sin FILE* de destino el texto se entrega a destino->texto a través de un
+   FILE* propio (fopencookie): los módulos siguen escribiendo con fprintf */
+static ssize_t escribir_texto(void* cookie, const char* datos, size_t longitud) {
+    const cal_destino* d = cookie;
+    if (d->texto) d->texto(d->usuario, datos, longitud);
+    return (ssize_t)longitud;
+}
+
+static FILE* abrir_salida(const cal_destino* d) {
+    cookie_io_functions_t funciones = { .write = escribir_texto };
+    if (d->salida) return d->salida;
+    return fopencookie((void*)d, "w", funciones);
+}
+
+/* Compila lo que tenga el escáner de 'c' y lo libera. El estado de los
+   módulos es del hilo y al terminar queda vacío para la siguiente. */
+static int compilar(compilacion* c) {
+    const cal_opciones* op = c->opciones;
+    FILE* salida = abrir_salida(c->destino);
+    if (!salida) {
+        error_sistema(c, "No se puede crear la salida");
+        yylex_destroy(c->escaner);
+        return 1;
+    }
+    actual = c;
+    est_reiniciar(c->ajustes->estadisticas);
+    traza_reiniciar(&c->ajustes->traza);
+    /* En continuo los quads se imprimen antes de que las pasadas los vean */
+    if (op->continua && op->formato == CAL_TEXTO && !opt_pasada_global_activa(&c->ajustes->optimizacion)) sem_salida_continua(salida);
+    if (op->nombre && op->formato == CAL_TEXTO) fprintf(salida, "Generando C3A para: %s\n", op->nombre);
     
-    yyparse();
+    /* El léxico va primero en el informe; su tiempo se resta del sintáctico */
+    est_sumar_fase("lexico", 0, 0);
+    int fase = est_empezar_fase("sintactico");
+    yyparse(c->escaner);
+    est_terminar_fase(fase);
+    est_separar_fase("sintactico", "lexico", c->ms_lexico);
     
-    sem_emitir("HALT"); 
-    sem_finalizar_salida(stdout);
+    int estado = 0;
+    if (c->abortada) {
+        /* Lo generado se descarta (sem_reiniciar) */
+        estado = 1;
+    } else {
+        sem_emitir(OP_HALT, sem_opnd_nulo(), sem_opnd_nulo(), sem_opnd_nulo()); 
+        opt_ejecutar_pasadas();
+
+        fase = est_empezar_fase("emision");
+        if (op->formato == CAL_EJECUTAR) {
+            /* Con errores de sintaxis o semánticos el programa no se ejecuta */
+            programa_vm* vm = c->errores == 0 ? vm_cargar() : NULL;
+            perfil* prf = vm && op->perfilar ? perf_crear() : NULL;
+            est_terminar_fase(fase);
+            fase = est_empezar_fase("ejecucion");
+            estado = vm ? vm_ejecutar(vm, salida, prf) : 1;
+            est_terminar_fase(fase);
+            fase = -1;
+            if (prf) {
+                /* El perfil también sirve cuando la ejecución aborta */
+                FILE* out = op->fichero_perfil ? fopen(op->fichero_perfil, "w") : stderr;
+                if (out) {
+                    fflush(salida);
+                    perf_informe(prf, out, op->nombre);
+                    if (out != stderr) fclose(out);
+                } else {
+                    char mensaje[300];
+                    snprintf(mensaje, sizeof(mensaje), "No se puede abrir el fichero de perfil %s", op->fichero_perfil);
+                    error_sistema(c, mensaje);
+                    estado = 1;
+                }
+                perf_liberar(prf);
+            }
+            vm_liberar(vm);
+            sem_liberar_codigo();
+        } else if (op->formato == CAL_C) {
+            estado = c->errores == 0 ? gc_emitir(salida, op->nombre) : 1;
+            sem_liberar_codigo();
+        } else if (op->formato == CAL_QUADS) {
+            const cal_destino* d = c->destino;
+            for (int i = 1; d->quad && i <= sem_num_quads(); i++) d->quad(d->usuario, i, sem_quad(i));
+            sem_liberar_codigo();
+        } else {
+            sem_finalizar_salida(salida);
+        }
+        est_terminar_fase(fase);
+        fflush(salida);
+        est_informe(stderr, op->nombre);
+    }
+
+    if (traza_finalizar(op->fichero_log)) {
+        char mensaje[300];
+        snprintf(mensaje, sizeof(mensaje), "No se puede abrir el fichero de traza %s", op->fichero_log);
+        error_sistema(c, mensaje);
+        estado = 1;
+    }
+    if (salida != c->destino->salida) fclose(salida);
+    yylex_destroy(c->escaner);
+    actual = NULL;
+    sem_reiniciar();
+    sym_clear();
+    atomos_liberar();
+    arena_liberar();
+    return estado;
+}
+
+static const cal_opciones opciones_por_defecto = { .formato = CAL_TEXTO };
+static const cal_destino destino_por_defecto = { .salida = NULL };
+
+static int preparar(compilacion* c, const cal_opciones* opciones, const cal_destino* destino) {
+    memset(c, 0, sizeof(*c));
+    c->opciones = opciones ? opciones : &opciones_por_defecto;
+    c->destino = destino ? destino : &destino_por_defecto;
+    if (actual) {
+        /* Desde una función del destino: el estado del hilo es de la otra */
+        error_compilacion(c, CAL_SISTEMA, 0, "No se puede compilar dentro de otra compilación del mismo hilo", NULL);
+        return 0;
+    }
+    c->ajustes = c->opciones->ajustes ? c->opciones->ajustes : &ajustes_por_defecto;
+    opt_aplicar(&c->ajustes->optimizacion);
+    if (yylex_init_extra(c, &c->escaner)) {
+        error_sistema(c, "No se puede crear el escáner");
+        return 0;
+    }
+    return 1;
+}
+
+/* --- ENTRADA PROYECTADA --- */
+
+/* Un fichero regular se proyecta en memoria y flex lo escanea en sitio
+   (yy_scan_buffer) en lugar de copiarlo por bloques a sus buffers. Flex
+   necesita dos '\0' detrás del texto y escribe en él mientras escanea
+   (acaba cada yytext con un '\0' y luego lo restaura): la proyección es
+   privada, así que el fichero no cambia, y va sobre una reserva anónima
+   una página más larga por si el texto acaba justo al final de una (lo
+   que sobra de la última página del fichero ya son ceros). */
+typedef struct {
+    char* base;
+    size_t largo;       // De la reserva entera (para munmap)
+    char* texto;        // Desde la posición actual del FILE*
+    size_t longitud;    // Del texto, con los dos '\0'
+} proyeccion;
+
+static int proyectar(FILE* entrada, proyeccion* p) {
+    struct stat info;
+    int fd = fileno(entrada);
+    off_t posicion = ftello(entrada);
+    if (fd < 0 || posicion < 0 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return 0;
+    /* Vacío o ya leído: no hay nada que proyectar. Flex guarda los tamaños en int. */
+    if (info.st_size <= posicion || info.st_size - posicion > INT_MAX - 2) return 0;
+
+    size_t tamano = (size_t)info.st_size;
+    size_t pagina = (size_t)sysconf(_SC_PAGESIZE);
+    p->largo = (tamano + 2 + pagina - 1) / pagina * pagina;
+    p->base = mmap(NULL, p->largo, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p->base == MAP_FAILED) return 0;
+    if (mmap(p->base, tamano, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(p->base, p->largo);
+        return 0;
+    }
+    madvise(p->base, tamano, MADV_SEQUENTIAL);
+    p->texto = p->base + posicion;
+    p->longitud = tamano - (size_t)posicion + 2;
+    return 1;
+}
 
-    fclose(logfile);
-    if (argc > 1) fclose(yyin);
-    return 0;
-}
\ No newline at end of file
+int cal_compilar_fichero(FILE* entrada, const cal_opciones* opciones, const cal_destino* destino) {
+    compilacion c;
+    proyeccion p;
+    int proyectado = 0;
+    if (!preparar(&c, opciones, destino)) return 1;
+    if (proyectar(entrada, &p)) {
+        proyectado = yy_scan_buffer(p.texto, p.longitud, c.escaner) != NULL;
+        if (!proyectado) munmap(p.base, p.largo);
+    }
+    if (proyectado) {
+        yyset_lineno(1, c.escaner);     /* Con un buffer flex no la inicializa */
+        fseeko(entrada, 0, SEEK_END);   /* Queda leído, como con yyset_in */
+    } else {
+        /* Tubería, terminal, fichero vacío...: flex lo lee por bloques */
+        yyset_in(entrada, c.escaner);
+    }
+    int estado = compilar(&c);
+    if (proyectado) munmap(p.base, p.largo);
+    return estado;
+}
+
+/* flex solo escanea en sitio un buffer escribible acabado en dos '\0'
+   (yy_scan_buffer); el de quien llama es const y no los lleva, así que
+   yy_scan_bytes lo copia una vez. Sin ficheros temporales. */
+int cal_compilar_buffer(const char* fuente, size_t longitud,
+                        const cal_opciones* opciones, const cal_destino* destino) {
+    compilacion c;
+    if (!preparar(&c, opciones, destino)) return 1;
+    if (longitud > INT_MAX - 2) {
+        char mensaje[100];
+        snprintf(mensaje, sizeof(mensaje), "Programa demasiado grande (%zu bytes)", longitud);
+        error_compilacion(&c, CAL_SISTEMA, 0, mensaje, NULL);
+        yylex_destroy(c.escaner);
+        return 1;
+    }
+    if (!yy_scan_bytes(fuente, (int)longitud, c.escaner)) {
+        error_sistema(&c, "No se puede crear el buffer del escáner");
+        yylex_destroy(c.escaner);
+        return 1;
+    }
+    yyset_lineno(1, c.escaner);     /* Con un buffer flex no la inicializa */
+    return compilar(&c);
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calculadora.h"
+
+/* Ejemplo de uso de libcalculadora (y prueba de 'make test-lib'): lee cada
+   fichero a memoria y lo compila dos veces con cal_compilar_buffer, una
+   para el listado C3A (que va a stdout y debe coincidir con el de
+   calculadora) y otra para recibir los quads como registros. Los errores
+   llegan por una función y se resumen al final por stderr. */
+
+typedef struct {
+    int quads;
+    int saltos;         // Quads con destino de salto
+    int errores;
+} resumen;
+
+static void texto(void* usuario, const char* datos, size_t longitud) {
+    (void)usuario;
+    fwrite(datos, 1, longitud, stdout);
+}
+
+static void contar_quad(void* usuario, int numero, const quad* q) {
+    resumen* r = usuario;
+    (void)numero;
+    r->quads++;
+    if (q->op == OP_IFI || q->op == OP_IFF || q->op == OP_GOTO) r->saltos++;
+}
+
+static void contar_error(void* usuario, const cal_diagnostico* d) {
+    resumen* r = usuario;
+    (void)d;
+    r->errores++;
+}
+
+/* El fichero entero en un buffer (sin '\0' final: no hace falta) */
+static char* leer(const char* fichero, size_t* longitud) {
+    FILE* f = fopen(fichero, "rb");
+    if (!f) {
+        perror(fichero);
+        return NULL;
+    }
+    size_t capacidad = 4096, n = 0, leidos;
+    char* buf = malloc(capacidad);
+    while (buf && (leidos = fread(buf + n, 1, capacidad - n, f)) > 0) {
+        n += leidos;
+        if (n == capacidad) buf = realloc(buf, capacidad *= 2);
+    }
+    fclose(f);
+    *longitud = n;
+    return buf;
+}
+
+int main(int argc, char* argv[]) {
+    int estado = 0;
+    cal_ajustes ajustes;
+    cal_ajustes_iniciales(&ajustes);
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            /* Ajustes de las compilaciones que siguen: -O2, --passes=..., --stats... */
+            if (cal_ajustar(&ajustes, argv[i]) <= 0) {
+                fprintf(stderr, "Opción desconocida '%s'\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        size_t longitud;
+        char* fuente = leer(argv[i], &longitud);
+        if (!fuente) {
+            estado = 1;
+            continue;
+        }
+        cal_opciones op = { .formato = CAL_TEXTO, .nombre = argv[i], .ajustes = &ajustes };
+        cal_destino listado = { .texto = texto };
+        if (cal_compilar_buffer(fuente, longitud, &op, &listado) != 0) estado = 1;
+
+        resumen r = { 0, 0, 0 };
+        cal_opciones op_quads = { .formato = CAL_QUADS, .nombre = argv[i], .ajustes = &ajustes };
+        cal_destino registros = { .usuario = &r, .quad = contar_quad, .diagnostico = contar_error };
+        if (cal_compilar_buffer(fuente, longitud, &op_quads, &registros) != 0) estado = 1;
+        fprintf(stderr, "%s: %d quads (%d saltos), %d errores\n", argv[i], r.quads, r.saltos, r.errores);
+        free(fuente);
+    }
+    return estado;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "estadisticas.h"
+#include "semantica.h"
+#include "symtab.h"
+
+#define MAX_FASES 32
+
+typedef struct {
+    const char* nombre;
+    double ms_real;
+    double ms_cpu;
+    double inicio_real;     /* Mientras está abierta */
+    double inicio_cpu;
+} fase_est;
+
+_Thread_local unsigned long long est_contadores[EST_NUM_CONTADORES];
+
+static const char* nombres_contadores[EST_NUM_CONTADORES] = {
+    [EST_TOKENS] = "tokens",
+    [EST_REDUCCIONES] = "reducciones",
+    [EST_QUADS] = "quads_emitidos",
+    [EST_BACKPATCH] = "backpatch",
+    [EST_HUECOS_RELLENADOS] = "saltos_rellenados",
+    [EST_NODOS_LISTA] = "nodos_lista",
+    [EST_NODOS_RESERVADOS] = "nodos_lista_reservados",
+};
+
+/* Medidas de la compilación en curso: cada hilo lleva las suyas */
+static _Thread_local formato_est formato = EST_NINGUNO;
+static _Thread_local fase_est fases[MAX_FASES];
+static _Thread_local int num_fases = 0;
+static _Thread_local double arranque_real, arranque_cpu;
+
+double est_reloj_real() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+void est_reloj(double* ms_real, double* ms_cpu) {
+    struct timespec ts;
+    *ms_real = est_reloj_real();
+    /* CPU del hilo: con varios ficheros a la vez cada uno mide lo suyo */
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    *ms_cpu = ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int est_procesar_opcion(formato_est* f, const char* arg) {
+    if (strcmp(arg, "--stats") == 0 || strcmp(arg, "--stats=texto") == 0) *f = EST_TEXTO;
+    else if (strcmp(arg, "--stats=json") == 0) *f = EST_JSON;
+    else if (strncmp(arg, "--stats=", 8) == 0) {
+        fprintf(stderr, "Error: Formato de estadísticas desconocido '%s' (texto o json)\n", arg + 8);
+        return -1;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int est_activas() {
+    return formato != EST_NINGUNO;
+}
+
+void est_reiniciar(formato_est f) {
+    formato = f;
+    memset(est_contadores, 0, sizeof(est_contadores));
+    num_fases = 0;
+    memset(fases, 0, sizeof(fases));
+    if (est_activas()) est_reloj(&arranque_real, &arranque_cpu);
+}
+
+/* --- FASES --- */
+
+static int buscar_fase(const char* nombre) {
+    for (int i = 0; i < num_fases; i++) {
+        if (strcmp(fases[i].nombre, nombre) == 0) return i;
+    }
+    if (num_fases == MAX_FASES) return -1;
+    fases[num_fases].nombre = nombre;
+    return num_fases++;
+}
+
+int est_empezar_fase(const char* nombre) {
+    if (!est_activas()) return -1;
+    int f = buscar_fase(nombre);
+    if (f >= 0) est_reloj(&fases[f].inicio_real, &fases[f].inicio_cpu);
+    return f;
+}
+
+void est_terminar_fase(int f) {
+    double real, cpu;
+    if (f < 0) return;
+    est_reloj(&real, &cpu);
+    fases[f].ms_real += real - fases[f].inicio_real;
+    fases[f].ms_cpu += cpu - fases[f].inicio_cpu;
+}
+
+void est_sumar_fase(const char* nombre, double ms_real, double ms_cpu) {
+    if (!est_activas()) return;
+    int f = buscar_fase(nombre);
+    if (f < 0) return;
+    fases[f].ms_real += ms_real;
+    fases[f].ms_cpu += ms_cpu;
+}
+
+void est_separar_fase(const char* de, const char* a, double ms_real) {
+    if (!est_activas()) return;
+    int f = buscar_fase(de);
+    if (f < 0 || fases[f].ms_real <= 0) return;
+    if (ms_real > fases[f].ms_real) ms_real = fases[f].ms_real;
+    double ms_cpu = fases[f].ms_cpu * (ms_real / fases[f].ms_real);
+    fases[f].ms_real -= ms_real;
+    fases[f].ms_cpu -= ms_cpu;
+    est_sumar_fase(a, ms_real, ms_cpu);
+}
+
+/* --- INFORME --- */
+
+/* Contadores que no se llevan aquí sino en cada módulo */
+typedef struct {
+    int quads_finales;
+    int temporales;
+    unsigned long busquedas_symtab;
+    unsigned long sondeos_symtab;
+    long memoria_max_kb;
+} resumen_est;
+
+static resumen_est resumir() {
+    resumen_est r;
+    struct rusage uso;
+    r.quads_finales = sem_num_quads();
+    r.temporales = sem_num_temporales();
+    sym_estadisticas(&r.busquedas_symtab, &r.sondeos_symtab);
+    r.memoria_max_kb = getrusage(RUSAGE_SELF, &uso) == 0 ? uso.ru_maxrss : 0;
+    return r;
+}
+
+static void escribir_cadena_json(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void informe_texto(FILE* out, const char* fichero, const resumen_est* r, double real, double cpu) {
+    fprintf(out, "--- Estadísticas de la compilación (%s) ---\n", fichero ? fichero : "stdin");
+    fprintf(out, "%-24s %12s %12s\n", "fase", "real ms", "CPU ms");
+    for (int i = 0; i < num_fases; i++) {
+        fprintf(out, "%-24s %12.3f %12.3f\n", fases[i].nombre, fases[i].ms_real, fases[i].ms_cpu);
+    }
+    fprintf(out, "%-24s %12.3f %12.3f\n", "total", real, cpu);
+    for (int c = 0; c < EST_NUM_CONTADORES; c++) {
+        fprintf(out, "%-24s %12llu\n", nombres_contadores[c], est_contadores[c]);
+    }
+    fprintf(out, "%-24s %12d\n", "quads_finales", r->quads_finales);
+    fprintf(out, "%-24s %12d\n", "temporales", r->temporales);
+    fprintf(out, "%-24s %12lu\n", "busquedas_symtab", r->busquedas_symtab);
+    fprintf(out, "%-24s %12lu\n", "sondeos_symtab", r->sondeos_symtab);
+    fprintf(out, "%-24s %12ld\n", "memoria_max_kb", r->memoria_max_kb);
+}
+
+/* Un objeto por línea: se pueden juntar los de varios ficheros */
+static void informe_json(FILE* out, const char* fichero, const resumen_est* r, double real, double cpu) {
+    fputs("{\"fichero\":", out);
+    if (fichero) escribir_cadena_json(out, fichero);
+    else fputs("null", out);
+    fputs(",\"fases\":[", out);
+    for (int i = 0; i < num_fases; i++) {
+        fputs(i ? ",{\"nombre\":" : "{\"nombre\":", out);
+        escribir_cadena_json(out, fases[i].nombre);
+        fprintf(out, ",\"real_ms\":%.3f,\"cpu_ms\":%.3f}", fases[i].ms_real, fases[i].ms_cpu);
+    }
+    fprintf(out, "],\"total\":{\"real_ms\":%.3f,\"cpu_ms\":%.3f},\"contadores\":{", real, cpu);
+    for (int c = 0; c < EST_NUM_CONTADORES; c++) {
+        fprintf(out, "\"%s\":%llu,", nombres_contadores[c], est_contadores[c]);
+    }
+    fprintf(out, "\"quads_finales\":%d,\"temporales\":%d,\"busquedas_symtab\":%lu,\"sondeos_symtab\":%lu,"
+            "\"memoria_max_kb\":%ld}}\n",
+            r->quads_finales, r->temporales, r->busquedas_symtab, r->sondeos_symtab, r->memoria_max_kb);
+}
+
+void est_informe(FILE* out, const char* fichero) {
+    if (!est_activas()) return;
+    double real, cpu;
+    est_reloj(&real, &cpu);
+    resumen_est r = resumir();
+    flockfile(out);     /* Los informes de varios hilos no se mezclan */
+    if (formato == EST_JSON) informe_json(out, fichero, &r, real - arranque_real, cpu - arranque_cpu);
+    else informe_texto(out, fichero, &r, real - arranque_real, cpu - arranque_cpu);
+    funlockfile(out);
+}
@@ -0,0 +1,63 @@
+#ifndef ESTADISTICAS_H
+#define ESTADISTICAS_H
+
+#include <stdio.h>
+
+/* Estadísticas de la compilación (--stats): tiempo real y de CPU de cada
+   fase y contadores de lo que ha hecho el compilador. Los contadores se
+   incrementan siempre (es una suma); los tiempos solo se miden con --stats.
+   Las medidas y el formato pedido son de cada hilo. */
+
+typedef enum { EST_NINGUNO, EST_TEXTO, EST_JSON } formato_est;
+
+typedef enum {
+    EST_TOKENS,             // Tokens devueltos por el léxico
+    EST_REDUCCIONES,        // Reducciones de la gramática
+    EST_QUADS,              // Quads emitidos al generar (con las copias del desenrollado)
+    EST_BACKPATCH,          // Llamadas a sem_backpatch con una lista no vacía
+    EST_HUECOS_RELLENADOS,  // Saltos rellenados por sem_backpatch
+    EST_NODOS_LISTA,        // Nodos de lista creados (sem_makelist)
+    EST_NODOS_RESERVADOS,   // Nodos reservados en el pool (crece por bloques)
+    EST_NUM_CONTADORES
+} contador_est;
+
+extern _Thread_local unsigned long long est_contadores[EST_NUM_CONTADORES];
+
+#define EST_CONTAR(c)    (est_contadores[c]++)
+#define EST_SUMAR(c, n)  (est_contadores[c] += (unsigned long long)(n))
+
+// Trata --stats y --stats=json cambiando 'f' (1 si era suya, 0 si no, -1
+// si es errónea)
+int est_procesar_opcion(formato_est* f, const char* arg);
+
+// Distinto de 0 si hay que medir (se ha pedido --stats)
+int est_activas();
+
+// Pone a cero las medidas del hilo al empezar un programa, que se miden e
+// informan en formato 'f' (EST_NINGUNO: no se mide): el total del informe
+// cuenta desde aquí
+void est_reiniciar(formato_est f);
+
+// Fases: est_empezar_fase devuelve un número para est_terminar_fase.
+// Una fase con el nombre de otra ya medida acumula su tiempo.
+int est_empezar_fase(const char* nombre);
+void est_terminar_fase(int fase);
+
+// Añade tiempo medido por fuera (p.ej. el léxico, que va a trozos)
+void est_sumar_fase(const char* nombre, double ms_real, double ms_cpu);
+
+// Pasa ms_real de tiempo real de la fase 'de' a la fase 'a', con la parte
+// proporcional de su tiempo de CPU (para el léxico, que se mide a trozos)
+void est_separar_fase(const char* de, const char* a, double ms_real);
+
+// Tiempo actual (real y de CPU del hilo) en ms
+void est_reloj(double* ms_real, double* ms_cpu);
+
+// Solo el tiempo real (más barato: no entra en el núcleo)
+double est_reloj_real();
+
+// Informe en el formato pedido (texto o JSON) si --stats está activo.
+// 'fichero' es el fuente compilado (o NULL).
+void est_informe(FILE* out, const char* fichero);
+
+#endif
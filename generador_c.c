@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "generador_c.h"
+#include "semantica.h"
+#include "symtab.h"
+
+/* El programa entero es la función main: cada variable es una local con el
+   prefijo v_ (así ningún nombre choca con C), los temporales son tN (enteros)
+   o fN (reales) y cada quad al que se salta lleva la etiqueta qN. Las
+   operaciones que pueden fallar pasan por las funciones c3a_* del prólogo,
+   que abortan con el mismo mensaje y código de salida que la máquina virtual. */
+
+#define MAX_PARAMS 256          /* PARAM pendientes antes de un CALL (como la VM) */
+
+#define TEMP_ENTERO 1           /* Bits de tipos_temp */
+#define TEMP_REAL   2
+
+typedef struct {
+    const char* nombre;
+    int tipo;
+    int tamanyo;            /* Elementos si es un array, -1 si no lo es */
+} variable_c;
+
+/* Estado de una traducción (de cada hilo) */
+static _Thread_local int num_quads;
+static _Thread_local char* es_destino;            /* Quads 1..num+1 a los que se salta */
+static _Thread_local unsigned char* tipos_temp;   /* TEMP_ENTERO | TEMP_REAL por temporal */
+static _Thread_local int usa_params;              /* Algún PARAM no va junto a su CALL */
+
+/* Variables, indexadas por el puntero del nombre (los nombres son únicos) */
+static _Thread_local variable_c* variables;
+static _Thread_local int num_variables;
+static _Thread_local int* indice_vars;            /* Hash: posición + 1, 0 = libre */
+static _Thread_local int cap_indice;
+
+/* --- PRÓLOGO DEL PROGRAMA GENERADO --- */
+
+static const char* const prologo =
+    "#include <stdio.h>\n"
+    "#include <stdlib.h>\n"
+    "#include <limits.h>\n"
+    "#include <math.h>\n"
+    "\n"
+    "static inline void c3a_error(int quad, const char* texto) {\n"
+    "    fflush(stdout);\n"
+    "    fprintf(stderr, \"Error de ejecución [quad %d]: %s\\n\", quad, texto);\n"
+    "    exit(1);\n"
+    "}\n"
+    "\n"
+    "static inline int c3a_divi(int x, int y, int quad) {\n"
+    "    if (y == 0) c3a_error(quad, \"división por cero\");\n"
+    "    return y == -1 ? (int)(0u - (unsigned)x) : x / y;\n"
+    "}\n"
+    "\n"
+    "static inline int c3a_modi(int x, int y, int quad) {\n"
+    "    if (y == 0) c3a_error(quad, \"módulo por cero\");\n"
+    "    return y == -1 ? 0 : x % y;\n"
+    "}\n"
+    "\n"
+    "static inline float c3a_divf(float x, float y, int quad) {\n"
+    "    if (y == 0.0f) c3a_error(quad, \"división por cero\");\n"
+    "    return x / y;\n"
+    "}\n"
+    "\n"
+    "static inline int c3a_poti(int base, int exponente, int quad) {\n"
+    "    unsigned r = 1, b = (unsigned)base;\n"
+    "    if (exponente < 0) c3a_error(quad, \"exponente entero negativo\");\n"
+    "    while (exponente > 0) {\n"
+    "        if (exponente & 1) r *= b;\n"
+    "        b *= b;\n"
+    "        exponente >>= 1;\n"
+    "    }\n"
+    "    return (int)r;\n"
+    "}\n"
+    "\n"
+    "static inline int c3a_f2i(float x) {\n"
+    "    if (x != x) return 0;\n"
+    "    if (x >= 2147483648.0f) return INT_MAX;\n"
+    "    if (x <= -2147483648.0f) return INT_MIN;\n"
+    "    return (int)x;\n"
+    "}\n"
+    "\n"
+    "/* Desplazamiento en bytes -> elemento, comprobando el rango */\n"
+    "static inline int c3a_indice(int desp, int tamanyo, int quad) {\n"
+    "    if (desp < 0 || (desp & 3) || (desp >> 2) >= tamanyo) c3a_error(quad, \"índice fuera de rango\");\n"
+    "    return desp >> 2;\n"
+    "}\n";
+
+static const char* const relaciones_c[] = { "==", "!=", "<", "<=", ">", ">=" };
+
+/* --- RECOGIDA DE VARIABLES Y TEMPORALES --- */
+
+static void* reservar(void* p, size_t tam) {
+    p = realloc(p, tam ? tam : 1);
+    if (!p) {
+        fprintf(stderr, "Error fatal: Sin memoria para el generador de C\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void* reservar_ceros(size_t num, size_t tam) {
+    void* p = calloc(num ? num : 1, tam);
+    if (!p) {
+        fprintf(stderr, "Error fatal: Sin memoria para el generador de C\n");
+        exit(1);
+    }
+    return p;
+}
+
+static unsigned mezclar(uintptr_t x) {
+    uint64_t h = (uint64_t)x;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned)h;
+}
+
+static int* buscar_variable(const char* nombre) {
+    if (2 * (num_variables + 1) > cap_indice) {
+        free(indice_vars);
+        cap_indice = cap_indice ? cap_indice * 2 : 256;
+        indice_vars = reservar_ceros(cap_indice, sizeof(int));
+        for (int k = 0; k < num_variables; k++) *buscar_variable(variables[k].nombre) = k + 1;
+    }
+    unsigned h = mezclar((uintptr_t)nombre) & (cap_indice - 1);
+    while (indice_vars[h] && variables[indice_vars[h] - 1].nombre != nombre) h = (h + 1) & (cap_indice - 1);
+    return &indice_vars[h];
+}
+
+/* Registra la variable (o el array) del operando. El tipo y el tamaño
+   salen de la declaración en la symtab. */
+static void anotar_variable(const operando* o, int es_array) {
+    int* h = buscar_variable(o->u.nombre);
+    if (*h) return;
+
+    variables = reservar(variables, sizeof(variable_c) * (num_variables + 1));
+    variable_c* v = &variables[num_variables];
+    sym_value_type info;
+    v->nombre = o->u.nombre;
+    v->tipo = o->tipo;
+    v->tamanyo = es_array ? 0 : -1;
+    if (sym_lookup(o->u.nombre, &info) == SYMTAB_OK) {
+        v->tipo = info->tipo;
+        if (es_array) v->tamanyo = info->tamanyo;
+    }
+    *h = ++num_variables;
+}
+
+static void anotar_operando(const operando* o) {
+    if (o->clase == OPND_VAR) anotar_variable(o, 0);
+    else if (o->clase == OPND_TEMP) tipos_temp[o->u.temp] |= o->tipo == T_REAL ? TEMP_REAL : TEMP_ENTERO;
+}
+
+static void anotar_destino(int destino) {
+    if (destino >= 1 && destino <= num_quads + 1) es_destino[destino] = 1;
+}
+
+/* PARAM que se traduce junto al CALL de la línea siguiente (un printf) */
+static int param_directo(int i) {
+    const quad* llamada;
+    if (i + 1 > num_quads || es_destino[i + 1]) return 0;
+    llamada = sem_quad(i + 1);
+    return llamada->op == OP_CALL && llamada->arg2.u.valor_int == 1;
+}
+
+/* CALL que se escribe junto a su PARAM */
+static int call_directo(int i) {
+    return i > 1 && sem_quad(i - 1)->op == OP_PARAM && param_directo(i - 1);
+}
+
+/* Primera vuelta: operandos, destinos de salto y comprobaciones.
+   Devuelve 0 si hay algo que no se sabe traducir. */
+static int recoger(void) {
+    for (int i = 1; i <= num_quads; i++) {
+        const quad* q = sem_quad(i);
+        switch (q->op) {
+            case OP_CARGA_IDX:
+                anotar_operando(&q->res);
+                anotar_variable(&q->arg1, 1);
+                anotar_operando(&q->arg2);
+                break;
+            case OP_GUARDA_IDX:
+                anotar_variable(&q->res, 1);
+                anotar_operando(&q->arg1);
+                anotar_operando(&q->arg2);
+                break;
+            case OP_IFI:
+            case OP_IFF:
+                anotar_operando(&q->arg1);
+                anotar_operando(&q->arg2);
+                anotar_destino(q->destino);
+                break;
+            case OP_GOTO:
+                anotar_destino(q->destino);
+                break;
+            case OP_GOTO_TABLA:
+                /* El switch salta directamente al destino de cada entrada */
+                anotar_operando(&q->arg1);
+                if (q->arg2.u.valor_int < 0 || i + q->arg2.u.valor_int > num_quads) {
+                    sem_error_quad(i, "Tabla de saltos incompleta", NULL);
+                    return 0;
+                }
+                for (int k = 1; k <= q->arg2.u.valor_int; k++) anotar_destino(sem_quad(i + k)->destino);
+                break;
+            case OP_PARAM:
+                anotar_operando(&q->arg1);
+                break;
+            case OP_CALL:
+                if (strcmp(q->arg1.u.nombre, "PUTI") != 0 && strcmp(q->arg1.u.nombre, "PUTF") != 0) {
+                    sem_error_quad(i, "Rutina desconocida", q->arg1.u.nombre);
+                    return 0;
+                }
+                break;
+            case OP_HALT:
+                break;
+            case OP_COPIA: case OP_ADDI: case OP_ADDF: case OP_SUBI: case OP_SUBF:
+            case OP_MULI: case OP_MULF: case OP_DIVI: case OP_DIVF: case OP_MODI:
+            case OP_POW: case OP_CHSI: case OP_CHSF: case OP_I2F:
+                anotar_operando(&q->res);
+                anotar_operando(&q->arg1);
+                anotar_operando(&q->arg2);
+                break;
+            default:
+                sem_error_quad(i, "Operación desconocida", NULL);
+                return 0;
+        }
+    }
+
+    /* Con los destinos ya marcados se sabe qué PARAM van solos */
+    for (int i = 1; i <= num_quads; i++) {
+        const quad* q = sem_quad(i);
+        if (q->op == OP_PARAM && !param_directo(i)) usa_params = 1;
+        if (q->op == OP_CALL && !call_directo(i)) usa_params = 1;
+    }
+    return 1;
+}
+
+static int compara_variables(const void* a, const void* b) {
+    return strcmp((*(const variable_c* const*)a)->nombre, (*(const variable_c* const*)b)->nombre);
+}
+
+/* --- ESCRITURA --- */
+
+static void escribir_operando(FILE* out, const operando* o) {
+    char texto[64];
+    switch (o->clase) {
+        case OPND_VAR:
+            fprintf(out, "v_%s", o->u.nombre);
+            break;
+        case OPND_TEMP:
+            fprintf(out, "%c%d", o->tipo == T_REAL ? 'f' : 't', o->u.temp);
+            break;
+        case OPND_ENTERO:
+            /* Negativos entre paréntesis: "- -3" o "--3" no son lo mismo */
+            if (o->u.valor_int == INT_MIN) fputs("(-2147483647 - 1)", out);
+            else if (o->u.valor_int < 0) fprintf(out, "(%d)", o->u.valor_int);
+            else fprintf(out, "%d", o->u.valor_int);
+            break;
+        case OPND_REAL:
+            if (isnan(o->u.valor_float)) {
+                fputs("NAN", out);
+            } else if (isinf(o->u.valor_float)) {
+                fputs(o->u.valor_float > 0 ? "INFINITY" : "(-INFINITY)", out);
+            } else {
+                /* 9 cifras bastan para recuperar el mismo float */
+                snprintf(texto, sizeof(texto), "%.9g", o->u.valor_float);
+                if (!strpbrk(texto, ".e")) strcat(texto, ".0");
+                fprintf(out, texto[0] == '-' ? "(%sf)" : "%sf", texto);
+            }
+            break;
+        default:
+            fputs("0", out);
+            break;
+    }
+}
+
+static void escribir_salto(FILE* out, int destino, int i) {
+    if (destino >= 1 && destino <= num_quads + 1) fprintf(out, "goto q%d;", destino);
+    else fprintf(out, "c3a_error(%d, \"salto sin destino\");", i);
+}
+
+/* Variables por orden alfabético y después los temporales */
+static void escribir_declaraciones(FILE* out) {
+    const variable_c** orden = reservar(NULL, sizeof(variable_c*) * num_variables);
+    for (int k = 0; k < num_variables; k++) orden[k] = &variables[k];
+    qsort(orden, num_variables, sizeof(variable_c*), compara_variables);
+    for (int k = 0; k < num_variables; k++) {
+        const variable_c* v = orden[k];
+        const char* tipo = v->tipo == T_REAL ? "float" : "int";
+        if (v->tamanyo >= 0)
+            fprintf(out, "    static %s v_%s[%d];\n", tipo, v->nombre, v->tamanyo > 0 ? v->tamanyo : 1);
+        else
+            fprintf(out, "    %s v_%s = 0;\n", tipo, v->nombre);
+    }
+    free(orden);
+    for (int t = 1; t <= sem_num_temporales(); t++) {
+        if (tipos_temp[t] & TEMP_ENTERO) fprintf(out, "    int t%d = 0;\n", t);
+        if (tipos_temp[t] & TEMP_REAL) fprintf(out, "    float f%d = 0;\n", t);
+    }
+    if (usa_params) {
+        fputs("    union { int i; float f; } params[" , out);
+        fprintf(out, "%d];\n    int num_params = 0;\n", MAX_PARAMS);
+    }
+}
+
+/* Elemento 'arr[desp]' con el tamaño del array declarado */
+static void escribir_elemento(FILE* out, const operando* arr, const operando* desp, int i) {
+    int* h = buscar_variable(arr->u.nombre);
+    fprintf(out, "v_%s[c3a_indice(", arr->u.nombre);
+    escribir_operando(out, desp);
+    fprintf(out, ", %d, %d)]", variables[*h - 1].tamanyo, i);
+}
+
+static void escribir_binaria(FILE* out, const quad* q, const char* op_c) {
+    escribir_operando(out, &q->res);
+    fputs(" = ", out);
+    escribir_operando(out, &q->arg1);
+    fprintf(out, " %s ", op_c);
+    escribir_operando(out, &q->arg2);
+    fputc(';', out);
+}
+
+/* Suma, resta y producto de enteros en módulo 2^32, como el plegado */
+static void escribir_entera(FILE* out, const quad* q, char op_c) {
+    escribir_operando(out, &q->res);
+    fputs(" = (int)((unsigned)", out);
+    escribir_operando(out, &q->arg1);
+    fprintf(out, " %c (unsigned)", op_c);
+    escribir_operando(out, &q->arg2);
+    fputs(");", out);
+}
+
+static void escribir_llamada(FILE* out, const quad* q, const char* func, int i) {
+    escribir_operando(out, &q->res);
+    fprintf(out, " = %s(", func);
+    escribir_operando(out, &q->arg1);
+    fputs(", ", out);
+    escribir_operando(out, &q->arg2);
+    fprintf(out, ", %d);", i);
+}
+
+static void escribir_quad(FILE* out, int i) {
+    const quad* q = sem_quad(i);
+    const char* formato;
+    int n;
+
+    if (q->op == OP_CALL && call_directo(i)) return;
+    if (es_destino[i]) fprintf(out, "q%d:\n", i);
+    fputs("    ", out);
+    switch (q->op) {
+        case OP_COPIA:
+            escribir_operando(out, &q->res);
+            fputs(" = ", out);
+            if (q->res.tipo == T_ENTERO && q->arg1.tipo == T_REAL) {
+                fputs("c3a_f2i(", out);
+                escribir_operando(out, &q->arg1);
+                fputs(");", out);
+            } else {
+                escribir_operando(out, &q->arg1);
+                fputc(';', out);
+            }
+            break;
+        case OP_ADDI: escribir_entera(out, q, '+'); break;
+        case OP_SUBI: escribir_entera(out, q, '-'); break;
+        case OP_MULI: escribir_entera(out, q, '*'); break;
+        case OP_ADDF: escribir_binaria(out, q, "+"); break;
+        case OP_SUBF: escribir_binaria(out, q, "-"); break;
+        case OP_MULF: escribir_binaria(out, q, "*"); break;
+        case OP_DIVI: escribir_llamada(out, q, "c3a_divi", i); break;
+        case OP_DIVF: escribir_llamada(out, q, "c3a_divf", i); break;
+        case OP_MODI: escribir_llamada(out, q, "c3a_modi", i); break;
+        case OP_POW:
+            if (q->arg1.tipo == T_REAL) {
+                escribir_operando(out, &q->res);
+                fputs(" = powf(", out);
+                escribir_operando(out, &q->arg1);
+                fputs(", ", out);
+                escribir_operando(out, &q->arg2);
+                fputs(");", out);
+            } else {
+                escribir_llamada(out, q, "c3a_poti", i);
+            }
+            break;
+        case OP_CHSI:
+            escribir_operando(out, &q->res);
+            fputs(" = (int)(0u - (unsigned)", out);
+            escribir_operando(out, &q->arg1);
+            fputs(");", out);
+            break;
+        case OP_CHSF:
+        case OP_I2F:
+            escribir_operando(out, &q->res);
+            fputs(q->op == OP_CHSF ? " = -" : " = (float)", out);
+            escribir_operando(out, &q->arg1);
+            fputc(';', out);
+            break;
+        case OP_CARGA_IDX:
+            escribir_operando(out, &q->res);
+            fputs(" = ", out);
+            escribir_elemento(out, &q->arg1, &q->arg2, i);
+            fputc(';', out);
+            break;
+        case OP_GUARDA_IDX:
+            escribir_elemento(out, &q->res, &q->arg1, i);
+            fputs(" = ", out);
+            escribir_operando(out, &q->arg2);
+            fputc(';', out);
+            break;
+        case OP_IFI:
+        case OP_IFF:
+            fputs("if (", out);
+            escribir_operando(out, &q->arg1);
+            fprintf(out, " %s ", relaciones_c[q->rel]);
+            escribir_operando(out, &q->arg2);
+            fputs(") ", out);
+            escribir_salto(out, q->destino, i);
+            break;
+        case OP_GOTO:
+            escribir_salto(out, q->destino, i);
+            break;
+        case OP_GOTO_TABLA:
+            /* gcc convierte el switch denso en su propia tabla de saltos */
+            n = q->arg2.u.valor_int;
+            fputs("switch (", out);
+            escribir_operando(out, &q->arg1);
+            fputs(") {\n", out);
+            for (int k = 0; k < n; k++) {
+                fprintf(out, "        case %d: ", k);
+                escribir_salto(out, sem_quad(i + 1 + k)->destino, i);
+                fputc('\n', out);
+            }
+            fprintf(out, "        default: c3a_error(%d, \"índice de la tabla de saltos fuera de rango\");\n    }", i);
+            break;
+        case OP_PARAM:
+            if (param_directo(i)) {
+                formato = strcmp(sem_quad(i + 1)->arg1.u.nombre, "PUTF") == 0 ? "%g" : "%d";
+                fprintf(out, "printf(\"%s\\n\", ", formato);
+                escribir_operando(out, &q->arg1);
+                fputs(");", out);
+            } else {
+                fprintf(out, "if (num_params == %d) c3a_error(%d, \"demasiados PARAM seguidos\");\n    ", MAX_PARAMS, i);
+                fprintf(out, "params[num_params++].%c = ", q->arg1.tipo == T_REAL ? 'f' : 'i');
+                escribir_operando(out, &q->arg1);
+                fputc(';', out);
+            }
+            break;
+        case OP_CALL:
+            n = q->arg2.u.valor_int;
+            formato = strcmp(q->arg1.u.nombre, "PUTF") == 0 ? "%g\\n\", params[k].f" : "%d\\n\", params[k].i";
+            fprintf(out, "if (num_params < %d) c3a_error(%d, \"faltan parámetros en la llamada\");\n", n, i);
+            fprintf(out, "    for (int k = num_params - %d; k < num_params; k++) printf(\"%s);\n", n, formato);
+            fprintf(out, "    num_params -= %d;", n);
+            break;
+        case OP_HALT:
+            fputs("return 0;", out);
+            break;
+        default:
+            break;
+    }
+    fputc('\n', out);
+}
+
+/* --- INTERFAZ --- */
+
+static void liberar_estado(void) {
+    free(es_destino);
+    free(tipos_temp);
+    free(variables);
+    free(indice_vars);
+    es_destino = NULL;
+    tipos_temp = NULL;
+    variables = NULL;
+    indice_vars = NULL;
+    num_variables = 0;
+    cap_indice = 0;
+    usa_params = 0;
+}
+
+int gc_emitir(FILE* out, const char* origen) {
+    num_quads = sem_num_quads();
+    es_destino = reservar_ceros(num_quads + 2, 1);
+    tipos_temp = reservar_ceros(sem_num_temporales() + 1, 1);
+
+    if (!recoger()) {
+        liberar_estado();
+        return 1;
+    }
+
+    fprintf(out, "/* Generado por calculadora a partir de %s (%d quads) */\n\n", origen ? origen : "la entrada estándar", num_quads);
+    fputs(prologo, out);
+    fputs("\nint main(void) {\n", out);
+    escribir_declaraciones(out);
+    fputc('\n', out);
+    for (int i = 1; i <= num_quads; i++) {
+        escribir_quad(out, i);
+        if (sem_quad(i)->op != OP_GOTO_TABLA) continue;
+        /* Las entradas ya están en el switch: solo se escriben si se salta a ellas */
+        int n = sem_quad(i)->arg2.u.valor_int;
+        for (int k = 1; k <= n; k++) {
+            if (es_destino[i + k]) escribir_quad(out, i + k);
+        }
+        i += n;
+    }
+    /* Se sale por el final */
+    if (es_destino[num_quads + 1]) fprintf(out, "q%d:\n", num_quads + 1);
+    fputs("    return 0;\n}\n", out);
+
+    liberar_estado();
+    return 0;
+}
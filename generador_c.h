@@ -0,0 +1,16 @@
+#ifndef GENERADOR_C_H
+#define GENERADOR_C_H
+
+#include <stdio.h>
+
+/* Traducción del C3A a un fichero C autocontenido (--emit-c): mismos quads
+   que ejecuta la máquina virtual (después de las pasadas de optimización y
+   antes de liberar el buffer), para compilarlos con gcc a código nativo. */
+
+// Escribe en 'out' el programa C equivalente a los quads 1..sem_num_quads().
+// 'origen' (o NULL) es el fichero fuente, solo para el comentario inicial.
+// Devuelve 0, o 1 (con el error por stderr y sin escribir nada) si usa
+// algo que no se sabe traducir.
+int gc_emitir(FILE* out, const char* origen);
+
+#endif
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "calculadora.h"
+
+/* Ejecutable calculadora: opciones de la línea de comandos y reparto de
+   ficheros entre hilos. La compilación es la de la biblioteca
+   (calculadora.h), igual que para cualquier otro cliente. */
+
+/* --- OPCIONES --- */
+
+/* Las de este fichero: las de las pasadas, --stats y la traza son los
+   ajustes por defecto de la biblioteca (cal_opcion). No cambian mientras
+   se compila. */
+static int ejecutar = 0;
+static int emitir_c = 0;
+static int perfilar = 0;
+static int continua = 0;
+static const char* fichero_perfil = NULL;
+static const char* fichero_log = NULL;  /* El de --log, de los ajustes */
+static const char* dir_salida = NULL;
+static int num_hilos = 0;          /* 0: uno por procesador */
+
+static void uso(const char* prog) {
+    fprintf(stderr, "Uso: %s [opciones] [fichero...]\n", prog);
+    fprintf(stderr, "  --run               compila y ejecuta el programa (sin listado C3A)\n");
+    fprintf(stderr, "  --emit-c            escribe el programa como fuente C en lugar del C3A\n");
+    fprintf(stderr, "  --profile[=fichero] ejecuta como --run y escribe el perfil (por defecto en stderr)\n");
+    fprintf(stderr, "  --stream            imprime el C3A mientras se genera (memoria acotada; sin pasadas\n");
+    fprintf(stderr, "                      sobre el programa completo: -O0 o --passes=plegado,...)\n");
+    fprintf(stderr, "  --stats[=json]      tiempos de cada fase y contadores de la compilación por stderr\n");
+    fprintf(stderr, "  --trace[=c1,c2]     guarda la traza en memoria (reglas, backpatch, pasadas, errores)\n");
+    fprintf(stderr, "                      y la escribe por stderr si hay un error\n");
+    fprintf(stderr, "  --log=fichero       escribe la traza en el fichero al terminar (todas las categorías\n");
+    fprintf(stderr, "                      si no se da --trace)\n");
+    fprintf(stderr, "  Varios ficheros (o --out-dir): cada uno se compila en un hilo y su salida va a\n");
+    fprintf(stderr, "  <nombre>.out (.c con --emit-c), la traza a <nombre>.log y el perfil a <nombre>.perfil\n");
+    fprintf(stderr, "  -j N                compila N ficheros a la vez (por defecto, uno por procesador)\n");
+    fprintf(stderr, "  --out-dir=dir       deja las salidas en dir (si no, junto a cada fuente)\n");
+    opt_ayuda(stderr);
+}
+
+/* Número de hilos de "-j N" o "-jN" */
+static int leer_hilos(const char* texto) {
+    char* fin;
+    long n = strtol(texto, &fin, 10);
+    if (*texto == '\0' || *fin != '\0' || n < 1 || n > 1024) {
+        fprintf(stderr, "Error: Número de hilos no válido '%s'\n", texto);
+        return -1;
+    }
+    num_hilos = (int)n;
+    return 1;
+}
+
+/* Opciones de la compilación de 'fichero' (NULL: stdin) */
+static cal_opciones opciones_de(const char* fichero, const char* fichero_log, const char* fichero_prf) {
+    cal_opciones op = {
+        .formato = ejecutar ? CAL_EJECUTAR : emitir_c ? CAL_C : CAL_TEXTO,
+        .nombre = fichero,
+        .continua = continua,
+        .perfilar = perfilar,
+        .fichero_perfil = fichero_prf,
+        .fichero_log = fichero_log,
+    };
+    return op;
+}
+
+/* --- VARIOS FICHEROS --- */
+
+/* Cola de ficheros por compilar: cada hilo coge el siguiente libre */
+static char** entradas;
+static int num_entradas;
+static int siguiente_entrada = 0;
+static int fallos = 0;
+static pthread_mutex_t cerrojo = PTHREAD_MUTEX_INITIALIZER;
+
+/* Con varios ficheros los errores llevan delante el nombre del suyo */
+static void diagnostico_con_nombre(void* usuario, const cal_diagnostico* d) {
+    (void)usuario;
+    flockfile(stderr);
+    fprintf(stderr, "%s: ", d->nombre);
+    cal_escribir_diagnostico(stderr, d);
+    funlockfile(stderr);
+}
+
+/* Nombre de la salida de 'fuente': el mismo sin la extensión, con la de la
+   salida, junto al fuente o en --out-dir */
+static char* ruta_salida(const char* fuente, const char* extension) {
+    const char* barra = strrchr(fuente, '/');
+    const char* nombre = dir_salida && barra ? barra + 1 : fuente;
+    const char* punto = strrchr(barra ? barra + 1 : fuente, '.');
+    size_t largo = punto && punto > nombre ? (size_t)(punto - nombre) : strlen(nombre);
+    size_t largo_dir = dir_salida ? strlen(dir_salida) + 1 : 0;
+
+    char* ruta = malloc(largo_dir + largo + strlen(extension) + 1);
+    if (!ruta) {
+        fprintf(stderr, "Error fatal: Sin memoria\n");
+        exit(1);
+    }
+    if (dir_salida) sprintf(ruta, "%s/", dir_salida);
+    memcpy(ruta + largo_dir, nombre, largo);
+    strcpy(ruta + largo_dir + largo, extension);
+    return ruta;
+}
+
+static int compilar_a_fichero(const char* fuente) {
+    FILE* entrada = fopen(fuente, "r");
+    if (!entrada) {
+        perror(fuente);
+        return 1;
+    }
+    char* ruta = ruta_salida(fuente, emitir_c ? ".c" : ".out");
+    char* ruta_log = fichero_log ? ruta_salida(fuente, ".log") : NULL;
+    char* ruta_prf = perfilar ? ruta_salida(fuente, ".perfil") : NULL;
+    int estado = 1;
+    FILE* salida = fopen(ruta, "w");
+    if (salida) {
+        cal_opciones op = opciones_de(fuente, ruta_log, ruta_prf);
+        cal_destino destino = { .salida = salida, .diagnostico = diagnostico_con_nombre };
+        estado = cal_compilar_fichero(entrada, &op, &destino);
+        if (fclose(salida) != 0) estado = 1;
+    } else {
+        perror(ruta);
+    }
+    fclose(entrada);
+    free(ruta);
+    free(ruta_log);
+    free(ruta_prf);
+    return estado;
+}
+
+static void* trabajador(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&cerrojo);
+        int i = siguiente_entrada++;
+        pthread_mutex_unlock(&cerrojo);
+        if (i >= num_entradas) break;
+        if (compilar_a_fichero(entradas[i]) != 0) {
+            pthread_mutex_lock(&cerrojo);
+            fallos++;
+            pthread_mutex_unlock(&cerrojo);
+        }
+    }
+    return NULL;
+}
+
+/* Salida de 'fuente' con el directorio resuelto (realpath): así "x.txt" y
+   "./x.txt" dan la misma. Con --out-dir todas van al mismo directorio y
+   basta con el nombre. */
+static char* clave_salida(const char* fuente) {
+    char* ruta = ruta_salida(fuente, "");
+    if (dir_salida) return ruta;
+    char* barra = strrchr(ruta, '/');
+    const char* nombre = barra ? barra + 1 : ruta;
+    if (barra) *barra = '\0';
+    char* dir = realpath(barra ? (barra == ruta ? "/" : ruta) : ".", NULL);
+    if (!dir) return ruta;
+    char* clave = malloc(strlen(dir) + strlen(nombre) + 2);
+    if (!clave) {
+        fprintf(stderr, "Error fatal: Sin memoria\n");
+        exit(1);
+    }
+    sprintf(clave, "%s/%s", dir, nombre);
+    free(dir);
+    free(ruta);
+    return clave;
+}
+
+typedef struct {
+    char* clave;
+    const char* fuente;
+} salida_lote;
+
+static int comparar_salidas(const void* a, const void* b) {
+    return strcmp(((const salida_lote*)a)->clave, ((const salida_lote*)b)->clave);
+}
+
+/* Dos fuentes con la misma salida (el mismo nombre en directorios distintos
+   con --out-dir, o el mismo fichero dos veces) se pisarían: se comprueba
+   antes de compilar nada. Devuelve 1 si hay alguna. */
+static int salidas_repetidas(char** fuentes, int n) {
+    salida_lote* salidas = malloc(sizeof(salida_lote) * n);
+    int repetidas = 0;
+    if (!salidas) {
+        fprintf(stderr, "Error fatal: Sin memoria\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        salidas[i].clave = clave_salida(fuentes[i]);
+        salidas[i].fuente = fuentes[i];
+    }
+    qsort(salidas, n, sizeof(salida_lote), comparar_salidas);
+    for (int i = 1; i < n; i++) {
+        if (strcmp(salidas[i - 1].clave, salidas[i].clave) == 0) {
+            char* ruta = ruta_salida(salidas[i].fuente, emitir_c ? ".c" : ".out");
+            fprintf(stderr, "Error: %s y %s tendrían la misma salida (%s)\n",
+                    salidas[i - 1].fuente, salidas[i].fuente, ruta);
+            free(ruta);
+            repetidas = 1;
+        }
+    }
+    for (int i = 0; i < n; i++) free(salidas[i].clave);
+    free(salidas);
+    return repetidas;
+}
+
+/* Reparte los ficheros entre los hilos; el principal también compila.
+   Devuelve 1 si alguno ha fallado. */
+static int compilar_lote(char** fuentes, int n) {
+    int hilos = num_hilos;
+    if (hilos == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        hilos = cpus > 0 ? (int)cpus : 1;
+    }
+    if (hilos > n) hilos = n;
+    if (salidas_repetidas(fuentes, n)) return 1;
+    if (dir_salida && mkdir(dir_salida, 0777) != 0 && errno != EEXIST) {
+        perror(dir_salida);
+        return 1;
+    }
+    entradas = fuentes;
+    num_entradas = n;
+
+    pthread_t* ids = malloc(sizeof(pthread_t) * hilos);
+    int lanzados = 0;
+    while (ids && lanzados < hilos - 1 && pthread_create(&ids[lanzados], NULL, trabajador, NULL) == 0) {
+        lanzados++;
+    }
+    trabajador(NULL);
+    for (int i = 0; i < lanzados; i++) pthread_join(ids[i], NULL);
+    free(ids);
+    return fallos ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    char* fuentes[argc];
+    int num_fuentes = 0;
+
+    for (int i = 1; i < argc; i++) {
+        int r = cal_opcion(argv[i]);
+        if (r < 0) return 1;
+        if (r > 0) continue;
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+            uso(argv[0]);
+            return 0;
+        }
+        if (strcmp(argv[i], "--run") == 0) {
+            ejecutar = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--emit-c") == 0) {
+            emitir_c = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--stream") == 0) {
+            continua = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--profile") == 0 || strncmp(argv[i], "--profile=", 10) == 0) {
+            ejecutar = perfilar = 1;
+            if (argv[i][9] == '=') fichero_perfil = argv[i] + 10;
+            continue;
+        }
+        if (strncmp(argv[i], "-j", 2) == 0) {
+            const char* valor = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+            if (leer_hilos(valor) < 0) return 1;
+            continue;
+        }
+        if (strncmp(argv[i], "--out-dir=", 10) == 0 && argv[i][10]) {
+            dir_salida = argv[i] + 10;
+            continue;
+        }
+        if (argv[i][0] == '-') {
+            uso(argv[0]);
+            return 1;
+        }
+        fuentes[num_fuentes++] = argv[i];
+    }
+
+    cal_ajustes ajustes;
+    cal_ajustes_iniciales(&ajustes);
+    fichero_log = ajustes.traza.fichero;
+
+    /* En continuo los quads se imprimen antes de que las pasadas los vean */
+    if (continua) {
+        const char* global = opt_pasada_global_activa(&ajustes.optimizacion);
+        if (ejecutar || emitir_c) {
+            fprintf(stderr, "Error: --stream solo sirve para imprimir el C3A (no con --run, --profile ni --emit-c)\n");
+            return 1;
+        }
+        if (global) {
+            fprintf(stderr, "Error: --stream no admite la pasada '%s' (usa -O0 o --passes con pasadas de generación)\n", global);
+            return 1;
+        }
+    }
+
+    int estado;
+    cal_destino destino = { .salida = stdout };
+    if (num_fuentes > 1 || dir_salida) {
+        estado = num_fuentes ? compilar_lote(fuentes, num_fuentes) : 1;
+        if (!num_fuentes) uso(argv[0]);
+    } else if (num_fuentes == 0) {
+        cal_opciones op = opciones_de(NULL, fichero_log, fichero_perfil);
+        estado = cal_compilar_fichero(stdin, &op, &destino);
+    } else {
+        /* Un solo fichero: todo a la salida estándar, como siempre */
+        FILE* entrada = fopen(fuentes[0], "r");
+        if (!entrada) {
+            perror("Error fichero");
+            return 1;
+        }
+        cal_opciones op = opciones_de(fuentes[0], fichero_log, fichero_perfil);
+        estado = cal_compilar_fichero(entrada, &op, &destino);
+        fclose(entrada);
+    }
+    return estado;
+}
@@ -0,0 +1,1588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "optimizador.h"
+#include "semantica.h"
+#include "estadisticas.h"
+#include "traza.h"
+
+/* --- AUXILIARES --- */
+
+static void* reservar_ceros(size_t num, size_t tam) {
+    void* p = calloc(num ? num : 1, tam);
+    if (!p) {
+        fprintf(stderr, "Error fatal: Sin memoria para el optimizador\n");
+        exit(1);
+    }
+    return p;
+}
+
+static int es_salto(op_c3a op) {
+    return op == OP_IFI || op == OP_IFF || op == OP_GOTO;
+}
+
+/* Entradas de la tabla de un GOTO TABLA: son los GOTO que le siguen y
+   no se pueden borrar ni separar de él (0 si no es un GOTO TABLA) */
+static int entradas_tabla(const quad* q) {
+    return q->op == OP_GOTO_TABLA ? q->arg2.u.valor_int : 0;
+}
+
+/* Operaciones que pueden abortar la ejecución (división por cero, índice
+   fuera de rango...): aunque su resultado no se use no se pueden borrar */
+static int puede_fallar(op_c3a op) {
+    return op == OP_DIVI || op == OP_DIVF || op == OP_MODI ||
+           op == OP_POW || op == OP_CARGA_IDX;
+}
+
+/* Misma variable o mismo temporal */
+static int mismo_operando(const operando* a, const operando* b) {
+    if (a->clase != b->clase) return 0;
+    if (a->clase == OPND_VAR) return a->u.nombre == b->u.nombre;
+    if (a->clase == OPND_TEMP) return a->u.temp == b->u.temp;
+    return 0;
+}
+
+static int es_conmutativa(op_c3a op) {
+    return op == OP_ADDI || op == OP_ADDF || op == OP_MULI || op == OP_MULF;
+}
+
+/* Marca los líderes de bloque básico: el quad 1, los destinos de salto y
+   los quads que siguen a un salto o a un HALT (las entradas de una tabla
+   son GOTO, así que cada una es un bloque) */
+static char* calcular_lideres(int n) {
+    char* lider = reservar_ceros(n + 2, 1);
+    lider[1] = 1;
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        if (es_salto(q->op)) {
+            if (q->destino >= 1 && q->destino <= n) lider[q->destino] = 1;
+            lider[i + 1] = 1;
+        } else if (q->op == OP_HALT || q->op == OP_GOTO_TABLA) {
+            lider[i + 1] = 1;
+        }
+    }
+    return lider;
+}
+
+/* --- COMPACTACIÓN --- */
+
+int opt_compactar(const char* borrar) {
+    int n = sem_num_quads();
+    int* nuevo = reservar_ceros(n + 2, sizeof(int));
+
+    /* nuevo[i] = número final del primer quad que sobrevive a partir de i */
+    int k = 0;
+    for (int i = 1; i <= n; i++) {
+        if (!borrar[i]) nuevo[i] = ++k;
+    }
+    int siguiente = k + 1;
+    nuevo[n + 1] = siguiente;
+    for (int i = n; i >= 1; i--) {
+        if (borrar[i]) nuevo[i] = siguiente;
+        else siguiente = nuevo[i];
+    }
+
+    /* Los quads solo se mueven hacia delante: se puede hacer en el sitio */
+    for (int i = 1; i <= n; i++) {
+        if (borrar[i]) continue;
+        quad q = *sem_quad(i);
+        if (es_salto(q.op) && q.destino >= 1 && q.destino <= n + 1) {
+            q.destino = nuevo[q.destino];
+        }
+        *sem_quad(nuevo[i]) = q;
+    }
+    sem_truncar(k);
+
+    free(nuevo);
+    return n - k;
+}
+
+/* --- CÓDIGO INALCANZABLE --- */
+
+/* Recorrido desde el quad 1 siguiendo los destinos de salto y la caída
+   al siguiente quad. Un GOTO sin destino (0) no lleva a ninguna parte y
+   un GOTO TABLA lleva a todas sus entradas. */
+int opt_eliminar_inalcanzable() {
+    int n = sem_num_quads();
+    if (n == 0) return 0;
+
+    char* borrar = reservar_ceros(n + 2, 1);
+    int* pendientes = reservar_ceros(n + 1, sizeof(int));
+    int num_pendientes = 0;
+
+    memset(borrar + 1, 1, n);
+    borrar[1] = 0;
+    pendientes[num_pendientes++] = 1;
+
+    while (num_pendientes > 0) {
+        int i = pendientes[--num_pendientes];
+        quad* q = sem_quad(i);
+        int sucesores[2], num_suc = 0;
+
+        if (es_salto(q->op) && q->destino >= 1 && q->destino <= n) {
+            sucesores[num_suc++] = q->destino;
+        }
+        if (q->op != OP_GOTO && q->op != OP_HALT && i < n) {
+            sucesores[num_suc++] = i + 1;
+        }
+        for (int k = 2; k <= entradas_tabla(q) && i + k <= n; k++) {
+            if (borrar[i + k]) {
+                borrar[i + k] = 0;
+                pendientes[num_pendientes++] = i + k;
+            }
+        }
+        for (int k = 0; k < num_suc; k++) {
+            if (borrar[sucesores[k]]) {
+                borrar[sucesores[k]] = 0;
+                pendientes[num_pendientes++] = sucesores[k];
+            }
+        }
+    }
+
+    int eliminados = opt_compactar(borrar);
+    free(pendientes);
+    free(borrar);
+    return eliminados;
+}
+
+/* --- OPTIMIZACIÓN DE SALTOS --- */
+
+/* Rondas como mucho de la optimización de saltos: cada una puede dejar
+   al descubierto nuevas cadenas o parejas, pero se estabiliza enseguida */
+#define MAX_RONDAS_SALTOS 8
+
+static int es_literal(const operando* o) {
+    return o->clase == OPND_ENTERO || o->clase == OPND_REAL;
+}
+
+static op_rel negar_rel(op_rel rel) {
+    switch (rel) {
+        case REL_EQ: return REL_NE;
+        case REL_NE: return REL_EQ;
+        case REL_LT: return REL_GE;
+        case REL_LE: return REL_GT;
+        case REL_GT: return REL_LE;
+        case REL_GE: return REL_LT;
+    }
+    return rel;
+}
+
+/* Destino final de un salto a 't': se siguen los GOTO encadenados.
+   Un ciclo de GOTO (bucle vacío infinito) se deja apuntando a sí mismo. */
+static int destino_final(int t, int n, int* final, char* estado, int* camino) {
+    int len = 0, fin;
+    int cur = t;
+    while (1) {
+        quad* q = sem_quad(cur);
+        if (q->op != OP_GOTO || q->destino < 1 || q->destino > n) { fin = cur; break; }
+        if (estado[cur] == 2) { fin = final[cur]; break; }
+        if (estado[cur] == 1) { fin = cur; break; }
+        estado[cur] = 1;
+        camino[len++] = cur;
+        cur = q->destino;
+    }
+    for (int k = 0; k < len; k++) {
+        final[camino[k]] = fin;
+        estado[camino[k]] = 2;
+    }
+    return fin;
+}
+
+/* Una ronda: enhebra las cadenas de saltos y simplifica cada salto.
+   Devuelve 1 si ha cambiado algo. */
+static int ronda_saltos(int* eliminados) {
+    int n = sem_num_quads();
+    int* final = reservar_ceros(n + 1, sizeof(int));
+    int* camino = reservar_ceros(n + 1, sizeof(int));
+    char* estado = reservar_ceros(n + 1, 1);
+    int* llegadas = reservar_ceros(n + 2, sizeof(int));
+    char* borrar = reservar_ceros(n + 2, 1);
+    int cambios = 0;
+
+    /* 1. Enhebrado: GOTO a GOTO a X pasa a ser GOTO a X */
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        if (!es_salto(q->op) || q->destino < 1 || q->destino > n) continue;
+        int d = destino_final(q->destino, n, final, estado, camino);
+        if (d != q->destino) {
+            q->destino = d;
+            cambios = 1;
+        }
+        llegadas[q->destino]++;
+    }
+
+    /* 2. Simplificación de cada salto */
+    for (int i = 1, entradas = 0; i <= n; i++) {
+        quad* q = sem_quad(i);
+
+        /* Las entradas de una tabla no se tocan. Una tabla con índice
+           literal es un GOTO a la entrada que toca. */
+        if (entradas > 0) {
+            entradas--;
+            continue;
+        }
+        if (q->op == OP_GOTO_TABLA) {
+            int k = q->arg1.u.valor_int;
+            if (q->arg1.clase == OPND_ENTERO && k >= 0 && k < entradas_tabla(q) && i + 1 + k <= n) {
+                q->op = OP_GOTO;
+                q->destino = sem_quad(i + 1 + k)->destino;
+                q->arg1 = q->arg2 = sem_opnd_nulo();
+                if (q->destino >= 1 && q->destino <= n) llegadas[q->destino]++;
+                cambios = 1;
+            } else {
+                entradas = entradas_tabla(q);
+            }
+            continue;
+        }
+        if (borrar[i] || !es_salto(q->op) || q->destino == 0) continue;
+
+        /* IF entre literales: o siempre salta o nunca */
+        if (q->op != OP_GOTO && es_literal(&q->arg1) && es_literal(&q->arg2)) {
+            if (sem_comparar_literales(q->rel, q->arg1, q->arg2)) {
+                q->op = OP_GOTO;
+                q->arg1 = q->arg2 = sem_opnd_nulo();
+            } else {
+                llegadas[q->destino]--;
+                borrar[i] = 1;
+            }
+            cambios = 1;
+            continue;
+        }
+
+        /* Salto al quad siguiente */
+        if (q->destino == i + 1) {
+            llegadas[q->destino]--;
+            borrar[i] = 1;
+            cambios = 1;
+            continue;
+        }
+
+        if (q->op == OP_GOTO || i + 1 > n) continue;
+        quad* sig = sem_quad(i + 1);
+        if (sig->op != OP_GOTO || sig->destino == 0 || borrar[i + 1]) continue;
+
+        /* IF c GOTO y; GOTO y: el IF sobra */
+        if (q->destino == sig->destino) {
+            llegadas[q->destino]--;
+            borrar[i] = 1;
+            cambios = 1;
+            continue;
+        }
+
+        /* IF c GOTO i+2; GOTO y  =>  IF not c GOTO y. Con reales solo se
+           invierten EQ/NE: con NaN 'not (a < b)' no es 'a >= b'. */
+        if (q->destino == i + 2 && llegadas[i + 1] == 0 &&
+            (q->op == OP_IFI || q->rel == REL_EQ || q->rel == REL_NE)) {
+            llegadas[q->destino]--;
+            q->rel = negar_rel(q->rel);
+            q->destino = sig->destino;
+            borrar[i + 1] = 1;
+            cambios = 1;
+        }
+    }
+
+    *eliminados += cambios ? opt_compactar(borrar) : 0;
+    free(borrar);
+    free(llegadas);
+    free(estado);
+    free(camino);
+    free(final);
+    return cambios;
+}
+
+int opt_optimizar_saltos() {
+    int eliminados = 0;
+    for (int r = 0; r < MAX_RONDAS_SALTOS; r++) {
+        if (!ronda_saltos(&eliminados)) break;
+        /* Un IF que ahora siempre salta deja sin entrada lo que le seguía */
+        eliminados += opt_eliminar_inalcanzable();
+    }
+    return eliminados;
+}
+
+/* --- NUMERACIÓN DE VALORES LOCAL --- */
+
+/* Valores que se recuerdan como mucho a la vez: un bloque más largo se
+   trata como varios seguidos (solo se pierde reutilización, y la memoria
+   no crece con programas de millones de líneas sin saltos) */
+#define MAX_VN_BLOQUE (1 << 16)
+
+/* Tabla de dispersión abierta que se vacía en O(1) al empezar cada bloque:
+   una entrada solo es válida si lleva la generación actual. */
+typedef struct {
+    intptr_t k1;
+    int k2, k3;
+    unsigned gen;
+    int valor;
+} entrada_vn;
+
+typedef struct {
+    entrada_vn* e;
+    int cap;        /* Potencia de 2 */
+    int vivas;
+} tabla_vn;
+
+static _Thread_local unsigned generacion = 1;
+
+static _Thread_local tabla_vn nombres;        /* Variable o literal -> VN actual */
+static _Thread_local tabla_vn expresiones;    /* (op, VN arg1, VN arg2) -> VN del resultado */
+static _Thread_local int* vn_temporal;        /* Temporal -> VN actual (vale si gen_temporal[t] == generacion) */
+static _Thread_local unsigned* gen_temporal;
+static _Thread_local operando* titulares;     /* VN -> operando que guarda ese valor */
+static _Thread_local int num_vn = 0;
+static _Thread_local int cap_vn = 0;
+
+static unsigned dispersar(intptr_t k1, int k2, int k3) {
+    uint64_t h = (uint64_t)k1 * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)(unsigned)k2 * 0xC2B2AE3D27D4EB4Full;
+    h ^= (uint64_t)(unsigned)k3 * 0x165667B19E3779F9ull;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return (unsigned)(h ^ (h >> 32));
+}
+
+static entrada_vn* ranura(tabla_vn* t, intptr_t k1, int k2, int k3) {
+    unsigned mascara = t->cap - 1;
+    unsigned i = dispersar(k1, k2, k3) & mascara;
+    while (t->e[i].gen == generacion) {
+        entrada_vn* e = &t->e[i];
+        if (e->k1 == k1 && e->k2 == k2 && e->k3 == k3) return e;
+        i = (i + 1) & mascara;
+    }
+    return &t->e[i]; /* Libre (o de un bloque anterior) */
+}
+
+static void crecer_tabla(tabla_vn* t) {
+    entrada_vn* viejas = t->e;
+    int cap_vieja = t->cap;
+    t->cap = cap_vieja ? cap_vieja * 2 : 256;
+    t->e = reservar_ceros(t->cap, sizeof(entrada_vn));
+    for (int i = 0; i < cap_vieja; i++) {
+        if (viejas[i].gen == generacion) {
+            *ranura(t, viejas[i].k1, viejas[i].k2, viejas[i].k3) = viejas[i];
+        }
+    }
+    free(viejas);
+}
+
+static int* tabla_buscar(tabla_vn* t, intptr_t k1, int k2, int k3) {
+    if (!t->cap) return NULL;
+    entrada_vn* e = ranura(t, k1, k2, k3);
+    return e->gen == generacion ? &e->valor : NULL;
+}
+
+static void tabla_poner(tabla_vn* t, intptr_t k1, int k2, int k3, int valor) {
+    if ((t->vivas + 1) * 2 > t->cap) crecer_tabla(t);
+    entrada_vn* e = ranura(t, k1, k2, k3);
+    if (e->gen != generacion) {
+        e->gen = generacion;
+        e->k1 = k1;
+        e->k2 = k2;
+        e->k3 = k3;
+        t->vivas++;
+    }
+    e->valor = valor;
+}
+
+static void liberar_tabla(tabla_vn* t) {
+    free(t->e);
+    t->e = NULL;
+    t->cap = t->vivas = 0;
+}
+
+/* Empieza un bloque básico: se olvidan todos los valores conocidos */
+static void nuevo_bloque() {
+    if (++generacion == 0) {
+        /* Vuelta del contador: las entradas a 0 volverían a parecer vivas */
+        if (nombres.e) memset(nombres.e, 0, sizeof(entrada_vn) * nombres.cap);
+        if (expresiones.e) memset(expresiones.e, 0, sizeof(entrada_vn) * expresiones.cap);
+        memset(gen_temporal, 0, sizeof(unsigned) * (sem_num_temporales() + 1));
+        generacion = 1;
+    }
+    nombres.vivas = expresiones.vivas = 0;
+    num_vn = 1; /* El VN 0 es "sin operando" */
+}
+
+static int nuevo_vn(operando titular) {
+    if (num_vn >= cap_vn) {
+        cap_vn = cap_vn ? cap_vn * 2 : 1024;
+        titulares = realloc(titulares, sizeof(operando) * cap_vn);
+        if (!titulares) {
+            fprintf(stderr, "Error fatal: Sin memoria para el optimizador\n");
+            exit(1);
+        }
+    }
+    titulares[num_vn] = titular;
+    return num_vn++;
+}
+
+/* Clave de una variable o literal en la tabla de nombres. Los literales
+   reales se distinguen por sus bits (leídos a través de la unión). */
+static void clave_operando(const operando* o, intptr_t* k1, int* k2) {
+    *k1 = 0;
+    if (o->clase == OPND_VAR) {
+        *k1 = (intptr_t)o->u.nombre;
+        *k2 = 0;
+    } else {
+        *k2 = o->u.valor_int;
+    }
+}
+
+/* Los temporales son números densos: van a un array y no a la tabla */
+static int* vn_buscar(const operando* o) {
+    if (o->clase == OPND_TEMP) {
+        int t = o->u.temp;
+        return gen_temporal[t] == generacion ? &vn_temporal[t] : NULL;
+    }
+    intptr_t k1;
+    int k2;
+    clave_operando(o, &k1, &k2);
+    return tabla_buscar(&nombres, k1, k2, o->clase);
+}
+
+static void vn_fijar(const operando* o, int vn) {
+    if (o->clase == OPND_TEMP) {
+        gen_temporal[o->u.temp] = generacion;
+        vn_temporal[o->u.temp] = vn;
+        return;
+    }
+    intptr_t k1;
+    int k2;
+    clave_operando(o, &k1, &k2);
+    tabla_poner(&nombres, k1, k2, o->clase, vn);
+}
+
+/* VN del valor actual de un operando (uno nuevo si aún no se conocía) */
+static int vn_de(const operando* o) {
+    if (o->clase == OPND_NULO) return 0;
+    int* p = vn_buscar(o);
+    if (p) return *p;
+    int vn = nuevo_vn(*o);
+    vn_fijar(o, vn);
+    return vn;
+}
+
+/* Operando que sigue guardando el valor 'vn' (un literal siempre lo
+   guarda; una variable o temporal solo si no se ha vuelto a asignar) */
+static int titular_valido(int vn, operando* titular) {
+    operando t = titulares[vn];
+    if (t.clase == OPND_NULO) return 0;
+    if (t.clase == OPND_VAR || t.clase == OPND_TEMP) {
+        int* p = vn_buscar(&t);
+        if (!p || *p != vn) return 0;
+    }
+    *titular = t;
+    return 1;
+}
+
+/* Sustituye una variable o temporal por el titular de su valor */
+static void propagar(operando* o) {
+    if (o->clase != OPND_VAR && o->clase != OPND_TEMP) return;
+    operando t;
+    if (titular_valido(vn_de(o), &t) && t.tipo == o->tipo) *o = t;
+}
+
+/* res := arg1. Si los tipos no coinciden la copia convierte el valor
+   y el destino no comparte VN con el origen. */
+static void numerar_copia(quad* q) {
+    int vn = vn_de(&q->arg1);
+    operando t;
+    if (q->res.tipo != q->arg1.tipo) {
+        vn = nuevo_vn(q->res);
+    } else if (!titular_valido(vn, &t)) {
+        titulares[vn] = q->res;
+    }
+    vn_fijar(&q->res, vn);
+}
+
+/* res := arg1 op arg2 (o una carga indexada). Si el mismo valor ya está
+   en algún sitio el quad pasa a ser una copia. */
+static void numerar_expresion(quad* q) {
+    int v1 = vn_de(&q->arg1);
+    int v2 = vn_de(&q->arg2);
+    if (es_conmutativa(q->op) && v1 > v2) {
+        int aux = v1; v1 = v2; v2 = aux;
+    }
+
+    int* p = tabla_buscar(&expresiones, q->op, v1, v2);
+    operando t;
+    if (p && titular_valido(*p, &t) && t.tipo == q->res.tipo) {
+        q->op = OP_COPIA;
+        q->arg1 = t;
+        q->arg2 = sem_opnd_nulo();
+        vn_fijar(&q->res, *p);
+        return;
+    }
+
+    int vn = nuevo_vn(q->res);
+    tabla_poner(&expresiones, q->op, v1, v2, vn);
+    vn_fijar(&q->res, vn);
+}
+
+static void numerar_quad(quad* q) {
+    operando plegado;
+    switch (q->op) {
+        case OP_COPIA:
+            propagar(&q->arg1);
+            numerar_copia(q);
+            break;
+        case OP_CARGA_IDX:
+            /* arg1 es el nombre del array: su VN cambia con cada escritura */
+            propagar(&q->arg2);
+            numerar_expresion(q);
+            break;
+        case OP_GUARDA_IDX:
+            propagar(&q->arg1);
+            propagar(&q->arg2);
+            vn_fijar(&q->res, nuevo_vn(sem_opnd_nulo()));
+            break;
+        case OP_IFI: case OP_IFF: case OP_PARAM: case OP_GOTO_TABLA:
+            propagar(&q->arg1);
+            propagar(&q->arg2);
+            break;
+        case OP_GOTO: case OP_CALL: case OP_HALT:
+            break;
+        default:
+            /* Aritmética y conversiones */
+            propagar(&q->arg1);
+            propagar(&q->arg2);
+            if (sem_plegar(q->op, q->arg1, q->arg2, &plegado)) {
+                q->op = OP_COPIA;
+                q->arg1 = plegado;
+                q->arg2 = sem_opnd_nulo();
+                numerar_copia(q);
+            } else {
+                numerar_expresion(q);
+            }
+            break;
+    }
+}
+
+static void contar_uso(int* usos, const operando* o, int delta) {
+    if (o->clase == OPND_TEMP) usos[o->u.temp] += delta;
+}
+
+/* Borra las definiciones de temporales que nadie lee y las copias x := x
+   (quedan al reutilizar un valor que ya estaba en el mismo sitio, como en
+   las copias de un cuerpo desenrollado). Se recorre hacia atrás para que
+   al borrar un quad sus operandos puedan quedar muertos. */
+static int eliminar_temporales_muertos() {
+    int n = sem_num_quads();
+    int* usos = reservar_ceros(sem_num_temporales() + 1, sizeof(int));
+    char* borrar = reservar_ceros(n + 2, 1);
+
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        contar_uso(usos, &q->arg1, 1);
+        contar_uso(usos, &q->arg2, 1);
+    }
+
+    int hay_muertos = 0;
+    for (int i = n; i >= 1; i--) {
+        quad* q = sem_quad(i);
+        int muerto = q->res.clase == OPND_TEMP && usos[q->res.u.temp] == 0 && !puede_fallar(q->op);
+        if (muerto || (q->op == OP_COPIA && mismo_operando(&q->res, &q->arg1))) {
+            borrar[i] = 1;
+            hay_muertos = 1;
+            contar_uso(usos, &q->arg1, -1);
+            contar_uso(usos, &q->arg2, -1);
+        }
+    }
+
+    int eliminados = hay_muertos ? opt_compactar(borrar) : 0;
+    free(borrar);
+    free(usos);
+    return eliminados;
+}
+
+int opt_numerar_valores() {
+    int n = sem_num_quads();
+    char* lider = calcular_lideres(n);
+    vn_temporal = reservar_ceros(sem_num_temporales() + 1, sizeof(int));
+    gen_temporal = reservar_ceros(sem_num_temporales() + 1, sizeof(unsigned));
+
+    for (int i = 1; i <= n; i++) {
+        if (lider[i] || num_vn > MAX_VN_BLOQUE) nuevo_bloque();
+        numerar_quad(sem_quad(i));
+    }
+
+    free(lider);
+    free(vn_temporal);
+    free(gen_temporal);
+    liberar_tabla(&nombres);
+    liberar_tabla(&expresiones);
+    free(titulares);
+    titulares = NULL;
+    num_vn = cap_vn = 0;
+
+    return eliminar_temporales_muertos();
+}
+
+/* --- INSERCIÓN DE QUADS --- */
+
+/* Las pasadas de bucles no borran sino que añaden código: la inicialización
+   en el preheader (delante de la cabecera) y actualizaciones detrás de
+   quads concretos. Se acumulan aquí y se aplican de una vez. */
+typedef struct {
+    int pos;        /* Quad junto al que se inserta */
+    int despues;    /* 0: delante de pos, 1: detrás */
+    int orden;      /* Orden de llegada (entre inserciones en el mismo sitio) */
+    quad q;
+} insercion;
+
+static _Thread_local insercion* inserciones = NULL;
+static _Thread_local int num_inserciones = 0;
+static _Thread_local int cap_inserciones = 0;
+
+static quad crear_quad(op_c3a op, operando res, operando arg1, operando arg2) {
+    quad q;
+    q.op = op;
+    q.rel = REL_EQ;
+    q.res = res;
+    q.arg1 = arg1;
+    q.arg2 = arg2;
+    q.destino = 0;
+    q.linea = 0;
+    return q;
+}
+
+static void insertar(int pos, int despues, quad q) {
+    if (num_inserciones == cap_inserciones) {
+        cap_inserciones = cap_inserciones ? cap_inserciones * 2 : 64;
+        inserciones = realloc(inserciones, sizeof(insercion) * cap_inserciones);
+        if (!inserciones) {
+            fprintf(stderr, "Error fatal: Sin memoria para el optimizador\n");
+            exit(1);
+        }
+    }
+    insercion* ins = &inserciones[num_inserciones];
+    ins->pos = pos;
+    ins->despues = despues;
+    ins->orden = num_inserciones++;
+    ins->q = q;
+    /* Un quad nuevo cuenta para la línea del quad junto al que va */
+    if (!ins->q.linea) ins->q.linea = sem_quad(pos)->linea;
+}
+
+static int comparar_inserciones(const void* x, const void* y) {
+    const insercion* a = x;
+    const insercion* b = y;
+    if (a->pos != b->pos) return a->pos < b->pos ? -1 : 1;
+    if (a->despues != b->despues) return a->despues - b->despues;
+    return a->orden - b->orden;
+}
+
+/* Reescribe el buffer con las inserciones pendientes, quitando además los
+   quads con borrar[i] != 0 si se indica (los que se han movido). Un salto
+   a un quad con código delante entra por ese código, salvo que venga de
+   dentro del propio bucle (h <= origen <= fin_bucle[h]): las vueltas no
+   repiten el preheader. Un salto a un quad borrado sigue por lo que venga
+   detrás, como si cayera desde él. */
+static int aplicar_inserciones(const int* fin_bucle, const char* borrar) {
+    int n = sem_num_quads();
+    int insertados = num_inserciones;
+    if (insertados == 0) return 0;
+    qsort(inserciones, num_inserciones, sizeof(insercion), comparar_inserciones);
+
+    int* antes = reservar_ceros(n + 2, sizeof(int));
+    int* nuevo = reservar_ceros(n + 2, sizeof(int));
+    quad* copia = reservar_ceros(n + 1, sizeof(quad));
+
+    int k = 1, j = 0;
+    for (int i = 1; i <= n; i++) {
+        antes[i] = k;
+        while (j < num_inserciones && inserciones[j].pos == i && !inserciones[j].despues) { k++; j++; }
+        nuevo[i] = k;
+        if (!borrar || !borrar[i]) k++;
+        while (j < num_inserciones && inserciones[j].pos == i) { k++; j++; }
+        copia[i] = *sem_quad(i);
+    }
+    antes[n + 1] = nuevo[n + 1] = k;
+
+    sem_truncar(0);
+    j = 0;
+    for (int i = 1; i <= n; i++) {
+        while (j < num_inserciones && inserciones[j].pos == i && !inserciones[j].despues) {
+            sem_emitir_quad(inserciones[j++].q);
+        }
+        quad q = copia[i];
+        int d = q.destino;
+        if (es_salto(q.op) && d >= 1 && d <= n + 1) {
+            int vuelta = d <= n && fin_bucle && d <= i && i <= fin_bucle[d];
+            q.destino = vuelta ? nuevo[d] : antes[d];
+        }
+        if (!borrar || !borrar[i]) sem_emitir_quad(q);
+        while (j < num_inserciones && inserciones[j].pos == i) {
+            sem_emitir_quad(inserciones[j++].q);
+        }
+    }
+
+    free(copia);
+    free(nuevo);
+    free(antes);
+    free(inserciones);
+    inserciones = NULL;
+    num_inserciones = cap_inserciones = 0;
+    return insertados;
+}
+
+/* --- BUCLES --- */
+
+/* Un bucle es el rango [h, fin] de una o más vueltas atrás (saltos de fin
+   a h <= fin). Solo se tratan los que tienen una única entrada, por h:
+   ningún salto de fuera del rango lleva a (h, fin]. Deja fin_bucle[h]
+   (0 si h no es cabecera) y devuelve las cabeceras de menor a mayor tamaño. */
+static int buscar_bucles(int n, int* fin_bucle, int** cabeceras) {
+    int* llegadas = reservar_ceros(n + 2, sizeof(int));  /* Acumulado de saltos recibidos */
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        if (!es_salto(q->op) || q->destino < 1 || q->destino > n) continue;
+        llegadas[q->destino]++;
+        if (q->destino <= i && i > fin_bucle[q->destino]) fin_bucle[q->destino] = i;
+    }
+    for (int i = 1; i <= n; i++) llegadas[i] += llegadas[i - 1];
+
+    int num = 0;
+    int* lista = reservar_ceros(n + 1, sizeof(int));
+    for (int h = 1; h <= n; h++) {
+        if (!fin_bucle[h]) continue;
+        /* Saltos a (h, fin] que salen de dentro del rango */
+        int fin = fin_bucle[h], internos = 0;
+        for (int i = h; i <= fin; i++) {
+            quad* q = sem_quad(i);
+            if (es_salto(q->op) && q->destino > h && q->destino <= fin) internos++;
+        }
+        if (llegadas[fin] - llegadas[h] == internos) lista[num++] = h;
+        else fin_bucle[h] = 0;
+    }
+
+    /* Interiores primero (ordenación por inserción: hay pocos bucles) */
+    for (int a = 1; a < num; a++) {
+        int h = lista[a], b = a;
+        while (b > 0 && fin_bucle[lista[b - 1]] - lista[b - 1] > fin_bucle[h] - h) {
+            lista[b] = lista[b - 1];
+            b--;
+        }
+        lista[b] = h;
+    }
+
+    free(llegadas);
+    *cabeceras = lista;
+    return num;
+}
+
+/* --- MOVIMIENTO DE CÓDIGO INVARIANTE --- */
+
+/* Un quad del bucle cuyo valor no cambia entre vueltas (sus operandos no
+   se asignan dentro o son a su vez invariantes) se calcula una sola vez
+   en el preheader. Solo se mueven operaciones que no pueden fallar: si el
+   bucle no da ninguna vuelta, moverlas no debe cambiar nada. Por lo mismo
+   el resultado no puede estar vivo fuera del bucle (ningún bloque de fuera
+   lo lee antes de asignarlo: una variable que se lee después conservaría
+   su valor anterior si el bucle no se ejecuta) ni en la cabecera: todo
+   camino que llega a un uso dentro del bucle pasa antes por la definición,
+   así que ningún uso lee el valor de antes. */
+
+/* Vueltas como mucho: cada una saca el código un nivel de anidamiento */
+#define MAX_RONDAS_INVARIANTES 4
+
+static _Thread_local int quads_movidos = 0;      /* Para el informe */
+
+static _Thread_local tabla_vn ids_variables;  /* Nombre de variable -> identificador */
+static _Thread_local int num_ids = 0;         /* Temporales 1..T y después las variables */
+
+/* Bloques que leen el valor antes de asignarlo (en todo el programa y
+   dentro del bucle actual) y último bloque visto en cada recorrido */
+static _Thread_local int* expuestos = NULL;
+static _Thread_local int* expuestos_bucle = NULL;
+static _Thread_local int* visto = NULL;
+static _Thread_local int* visto_bucle = NULL;
+static _Thread_local int* definiciones_bucle = NULL;
+static _Thread_local int* marca_id = NULL;            /* Bucle en el que valen los de arriba */
+static _Thread_local int* movido = NULL;              /* Bucle del que se ha sacado su definición */
+
+/* Recorrido del bucle para ver si un valor está vivo en la cabecera */
+static _Thread_local int* visita = NULL;
+static _Thread_local int* pila_visita = NULL;
+static _Thread_local int num_visita = 0;
+
+/* Identificador denso de una variable o temporal (-1 para los literales) */
+static int id_operando(const operando* o) {
+    if (o->clase == OPND_TEMP) return o->u.temp;
+    if (o->clase != OPND_VAR) return -1;
+    int* p = tabla_buscar(&ids_variables, (intptr_t)o->u.nombre, 0, 0);
+    if (p) return *p;
+    tabla_poner(&ids_variables, (intptr_t)o->u.nombre, 0, 0, num_ids);
+    return num_ids++;
+}
+
+/* Primera aparición de id en el bloque b: si es un uso, el bloque lo lee */
+static void anotar_exposicion(int id, int b, int es_def, int* vistos, int* cuenta) {
+    if (vistos[id] == b) return;
+    vistos[id] = b;
+    if (!es_def) cuenta[id]++;
+}
+
+static void anotar_en_bucle(const operando* o, int b, int es_def, int bucle) {
+    int id = id_operando(o);
+    if (id < 0) return;
+    if (marca_id[id] != bucle) {
+        marca_id[id] = bucle;
+        expuestos_bucle[id] = definiciones_bucle[id] = visto_bucle[id] = 0;
+    }
+    anotar_exposicion(id, b, es_def, visto_bucle, expuestos_bucle);
+    if (es_def) definiciones_bucle[id]++;
+}
+
+/* ¿Hay algún camino dentro de [h, fin] que salga de la cabecera y lea r
+   antes de asignarlo? (Fuera del bucle nadie lo lee: ya se ha comprobado) */
+static int vivo_en_cabecera(int r, int h, int fin) {
+    int cima = 0;
+    num_visita++;
+    pila_visita[cima++] = h;
+    visita[h] = num_visita;
+    while (cima > 0) {
+        int i = pila_visita[--cima];
+        quad* q = sem_quad(i);
+        if (id_operando(&q->arg1) == r || id_operando(&q->arg2) == r) return 1;
+        if (id_operando(&q->res) == r) {
+            if (q->op == OP_GUARDA_IDX) return 1;
+            continue;                           /* Este camino lo asigna */
+        }
+        int d = q->destino;
+        if (es_salto(q->op) && d >= h && d <= fin && visita[d] != num_visita) {
+            visita[d] = num_visita;
+            pila_visita[cima++] = d;
+        }
+        if (q->op != OP_GOTO && q->op != OP_HALT && i < fin && visita[i + 1] != num_visita) {
+            visita[i + 1] = num_visita;
+            pila_visita[cima++] = i + 1;
+        }
+        for (int k = 2; k <= entradas_tabla(q) && i + k <= fin; k++) {
+            if (visita[i + k] == num_visita) continue;
+            visita[i + k] = num_visita;
+            pila_visita[cima++] = i + k;
+        }
+    }
+    return 0;
+}
+
+/* Solo operaciones sin efectos que no pueden abortar la ejecución */
+static int se_puede_mover(const quad* q) {
+    const operando* d = &q->arg2;
+    switch (q->op) {
+        case OP_COPIA: case OP_ADDI: case OP_ADDF: case OP_SUBI: case OP_SUBF:
+        case OP_MULI: case OP_MULF: case OP_CHSI: case OP_CHSF: case OP_I2F:
+            return 1;
+        case OP_DIVI: case OP_MODI:
+            return d->clase == OPND_ENTERO && d->u.valor_int != 0 && d->u.valor_int != -1;
+        case OP_DIVF:
+            return d->clase == OPND_REAL && d->u.valor_float != 0.0f;
+        case OP_POW:
+            return d->clase == OPND_ENTERO && d->u.valor_int >= 0;
+        default:
+            return 0;
+    }
+}
+
+static int es_invariante(const operando* o, int bucle) {
+    int id = id_operando(o);
+    if (id < 0) return 1;
+    return marca_id[id] != bucle || definiciones_bucle[id] == 0 || movido[id] == bucle;
+}
+
+/* Saca del bucle [h, fin] lo invariante. Devuelve los quads movidos. */
+static int mover_invariantes(int h, int fin, int bucle, const int* bloque, char* borrar) {
+    for (int i = h; i <= fin; i++) {
+        quad* q = sem_quad(i);
+        anotar_en_bucle(&q->arg1, bloque[i], 0, bucle);
+        anotar_en_bucle(&q->arg2, bloque[i], 0, bucle);
+        anotar_en_bucle(&q->res, bloque[i], q->op != OP_GUARDA_IDX, bucle);
+    }
+
+    int movidos = 0;
+    for (int i = h; i <= fin; i++) {
+        quad* q = sem_quad(i);
+        if (borrar[i] || !se_puede_mover(q)) continue;
+        int r = id_operando(&q->res);
+        if (r < 0 || definiciones_bucle[r] != 1 || expuestos[r] != expuestos_bucle[r]) continue;
+        if (!es_invariante(&q->arg1, bucle) || !es_invariante(&q->arg2, bucle)) continue;
+        if (expuestos_bucle[r] > 0 && vivo_en_cabecera(r, h, fin)) continue;
+
+        insertar(h, 0, *q);
+        borrar[i] = 1;
+        movido[r] = bucle;
+        movidos++;
+    }
+    return movidos;
+}
+
+static int ronda_invariantes(int* num_bucle) {
+    int n = sem_num_quads();
+    int* fin_bucle = reservar_ceros(n + 2, sizeof(int));
+    int* cabeceras;
+    int num_bucles = buscar_bucles(n, fin_bucle, &cabeceras);
+    int movidos = 0;
+
+    if (num_bucles > 0) {
+        /* Bloque básico de cada quad y bloques que leen cada valor de fuera */
+        char* lider = calcular_lideres(n);
+        int* bloque = reservar_ceros(n + 2, sizeof(int));
+        memset(expuestos, 0, sizeof(int) * num_ids);
+        memset(visto, 0, sizeof(int) * num_ids);
+        for (int i = 1, b = 0; i <= n; i++) {
+            if (lider[i]) b++;
+            bloque[i] = b;
+            quad* q = sem_quad(i);
+            int a1 = id_operando(&q->arg1), a2 = id_operando(&q->arg2), r = id_operando(&q->res);
+            if (a1 >= 0) anotar_exposicion(a1, b, 0, visto, expuestos);
+            if (a2 >= 0) anotar_exposicion(a2, b, 0, visto, expuestos);
+            if (r >= 0) anotar_exposicion(r, b, q->op != OP_GUARDA_IDX, visto, expuestos);
+        }
+
+        char* borrar = reservar_ceros(n + 2, 1);
+        visita = reservar_ceros(n + 2, sizeof(int));
+        pila_visita = reservar_ceros(n + 2, sizeof(int));
+        num_visita = 0;
+        for (int b = 0; b < num_bucles; b++) {
+            int h = cabeceras[b];
+            movidos += mover_invariantes(h, fin_bucle[h], ++(*num_bucle), bloque, borrar);
+        }
+        aplicar_inserciones(fin_bucle, borrar);
+        free(pila_visita);
+        free(visita);
+        free(borrar);
+        free(bloque);
+        free(lider);
+    }
+    free(cabeceras);
+    free(fin_bucle);
+    return movidos;
+}
+
+int opt_mover_invariantes() {
+    /* Identificadores: todas las variables del programa (no aparecen nuevas) */
+    num_ids = sem_num_temporales() + 1;
+    int n = sem_num_quads();
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        id_operando(&q->res);
+        id_operando(&q->arg1);
+        id_operando(&q->arg2);
+    }
+    expuestos = reservar_ceros(num_ids, sizeof(int));
+    expuestos_bucle = reservar_ceros(num_ids, sizeof(int));
+    visto = reservar_ceros(num_ids, sizeof(int));
+    visto_bucle = reservar_ceros(num_ids, sizeof(int));
+    definiciones_bucle = reservar_ceros(num_ids, sizeof(int));
+    marca_id = reservar_ceros(num_ids, sizeof(int));
+    movido = reservar_ceros(num_ids, sizeof(int));
+
+    int num_bucle = 0, ronda = 0, movidos;
+    do {
+        movidos = ronda_invariantes(&num_bucle);
+        quads_movidos += movidos;
+    } while (movidos > 0 && ++ronda < MAX_RONDAS_INVARIANTES);
+
+    free(movido);
+    free(marca_id);
+    free(definiciones_bucle);
+    free(visto_bucle);
+    free(visto);
+    free(expuestos_bucle);
+    free(expuestos);
+    liberar_tabla(&ids_variables);
+    return 0; /* Mueve quads, no los borra */
+}
+
+static void informe_invariantes(FILE* out) {
+    fprintf(out, "invariantes: %d quads sacados de los bucles\n", quads_movidos);
+}
+
+/* --- REDUCCIÓN DE FUERZA (VARIABLES DE INDUCCIÓN) --- */
+
+/* Una variable de inducción básica i (el iterador de un for, el contador de
+   un repeat...) solo cambia en el bucle con incrementos constantes. Los
+   temporales a·i + b que se calculan a partir de ella (el desplazamiento
+   i MULI 4 de un acceso a array, v[i+1]...) pasan a ser variables nuevas
+   s = a·i + c que se inicializan en el preheader y se incrementan en a·k
+   detrás de cada i := i + k, de modo que la multiplicación desaparece. */
+
+#define MAX_INDUCCION 32    /* Variables de inducción candidatas por bucle */
+#define MAX_REDUCIDAS 16    /* Variables s = a·i + c nuevas por bucle */
+
+/* Valor a·i0 + b, con i0 el valor de la variable i al empezar el bloque
+   (aritmética módulo 2^32, como la de los enteros) */
+typedef struct {
+    int iv;
+    unsigned a, b;
+    unsigned marca;     /* Bloque en el que vale (formas de temporales) */
+} forma_lineal;
+
+typedef struct {
+    int iv;
+    unsigned a, c;
+    operando s;
+} reducida;
+
+static _Thread_local operando ivs[MAX_INDUCCION];
+static _Thread_local char iv_valida[MAX_INDUCCION];
+static _Thread_local unsigned desplazamiento[MAX_INDUCCION];  /* i = i0 + desplazamiento */
+static _Thread_local int num_ivs = 0;
+
+static _Thread_local forma_lineal* formas = NULL;     /* Temporal -> forma lineal */
+static _Thread_local int num_formas = 0;
+static _Thread_local unsigned marca_bloque = 0;
+
+static _Thread_local reducida reducidas[MAX_REDUCIDAS];
+static _Thread_local int num_reducidas = 0;
+
+/* Estadísticas para el informe */
+static _Thread_local int bucles_reducidos = 0;
+static _Thread_local int multiplicaciones_reducidas = 0;
+
+static int buscar_iv(const operando* o) {
+    for (int k = 0; k < num_ivs; k++) {
+        if (mismo_operando(&ivs[k], o)) return k;
+    }
+    return -1;
+}
+
+static int forma_operando(const operando* o, forma_lineal* f) {
+    int k = buscar_iv(o);
+    if (k >= 0 && iv_valida[k]) {
+        f->iv = k; f->a = 1; f->b = desplazamiento[k];
+        return 1;
+    }
+    if (o->clase == OPND_TEMP && o->u.temp < num_formas) {
+        forma_lineal* t = &formas[o->u.temp];
+        if (t->marca != marca_bloque || !iv_valida[t->iv]) return 0;
+        *f = *t;
+        return 1;
+    }
+    return 0;
+}
+
+/* Forma del resultado de q: copias, sumas, restas y productos por un literal */
+static int forma_quad(const quad* q, forma_lineal* f) {
+    if (q->res.tipo != T_ENTERO) return 0;
+    const operando* x = &q->arg1;
+    const operando* k = &q->arg2;
+    if (es_conmutativa(q->op) && x->clase == OPND_ENTERO) {
+        x = &q->arg2;
+        k = &q->arg1;
+    }
+    if (q->op == OP_COPIA) return forma_operando(x, f);
+    if (k->clase != OPND_ENTERO || !forma_operando(x, f)) return 0;
+
+    unsigned v = (unsigned)k->u.valor_int;
+    switch (q->op) {
+        case OP_ADDI: f->b += v; return 1;
+        case OP_SUBI: f->b -= v; return 1;
+        case OP_MULI: f->a *= v; f->b *= v; return 1;
+        default: return 0;
+    }
+}
+
+static void anotar_forma(const operando* res, const forma_lineal* f) {
+    if (res->clase != OPND_TEMP || res->u.temp >= num_formas) return;
+    if (f) {
+        formas[res->u.temp] = *f;
+        formas[res->u.temp].marca = marca_bloque;
+    } else {
+        formas[res->u.temp].marca = 0;
+    }
+}
+
+static void nuevo_bloque_formas() {
+    marca_bloque++;
+    memset(desplazamiento, 0, sizeof(desplazamiento));
+}
+
+/* Modos del recorrido de un bucle */
+#define VALIDAR    0    /* Descarta las candidatas que no cambian con i := i + k */
+#define REDUCIR    1    /* Cambia las multiplicaciones por copias de su s */
+#define ACTUALIZAR 2    /* Inserta s := s + a·k detrás de cada incremento */
+
+/* Recorre el bucle siguiendo las formas. En modo VALIDAR devuelve si ha
+   descartado alguna candidata. Los incrementos se insertan en una vuelta
+   aparte porque una s puede aparecer después de alguno de ellos. */
+static int recorrer_bucle(int h, int fin, const char* lider, int modo) {
+    int descartadas = 0;
+    nuevo_bloque_formas();
+    for (int i = h; i <= fin; i++) {
+        if (lider[i] && i != h) nuevo_bloque_formas();
+        quad* q = sem_quad(i);
+        if (q->op == OP_GUARDA_IDX || es_salto(q->op) || q->res.clase == OPND_NULO) continue;
+
+        forma_lineal f;
+        int lineal = forma_quad(q, &f);
+        int k = buscar_iv(&q->res);
+        if (k >= 0 && iv_valida[k] && (!lineal || f.iv != k || f.a != 1)) {
+            /* Deja de ser candidata: a partir de aquí es un valor más */
+            iv_valida[k] = 0;
+            descartadas = 1;
+        } else if (k >= 0 && iv_valida[k]) {
+            if (modo == ACTUALIZAR) {
+                /* s := s + a·k detrás del incremento de cada s que depende de i */
+                unsigned incremento = f.b - desplazamiento[k];
+                for (int r = 0; r < num_reducidas; r++) {
+                    if (reducidas[r].iv != k || reducidas[r].a * incremento == 0) continue;
+                    operando s = reducidas[r].s;
+                    insertar(i, 1, crear_quad(OP_ADDI, s, s, sem_opnd_entero((int)(reducidas[r].a * incremento))));
+                }
+            }
+            desplazamiento[k] = f.b;
+            continue;
+        }
+
+        anotar_forma(&q->res, lineal ? &f : NULL);
+        if (modo != REDUCIR || !lineal || q->op != OP_MULI) continue;
+
+        /* En función del valor actual de i: a·i + c */
+        unsigned c = f.b - f.a * desplazamiento[f.iv];
+        int r = 0;
+        while (r < num_reducidas && !(reducidas[r].iv == f.iv && reducidas[r].a == f.a && reducidas[r].c == c)) r++;
+        if (r == num_reducidas) {
+            if (num_reducidas == MAX_REDUCIDAS) continue;
+            reducidas[r].iv = f.iv;
+            reducidas[r].a = f.a;
+            reducidas[r].c = c;
+            reducidas[r].s = sem_generar_temporal(T_ENTERO);
+            num_reducidas++;
+        }
+        q->op = OP_COPIA;
+        q->arg1 = reducidas[r].s;
+        q->arg2 = sem_opnd_nulo();
+        multiplicaciones_reducidas++;
+    }
+    return descartadas;
+}
+
+static void reducir_bucle(int h, int fin, const char* lider) {
+    /* Candidatas: escalares enteros que el bucle asigna con copias o sumas */
+    num_ivs = 0;
+    for (int i = h; i <= fin && num_ivs < MAX_INDUCCION; i++) {
+        quad* q = sem_quad(i);
+        if ((q->op == OP_COPIA || q->op == OP_ADDI || q->op == OP_SUBI) &&
+            q->res.tipo == T_ENTERO && buscar_iv(&q->res) < 0) {
+            iv_valida[num_ivs] = 1;
+            ivs[num_ivs++] = q->res;
+        }
+    }
+    /* Cada descarte puede invalidar formas de las demás: hasta que no cambie */
+    while (recorrer_bucle(h, fin, lider, VALIDAR));
+
+    int hay = 0;
+    for (int k = 0; k < num_ivs; k++) hay |= iv_valida[k];
+    if (!hay) return;
+
+    num_reducidas = 0;
+    recorrer_bucle(h, fin, lider, REDUCIR);
+    if (num_reducidas == 0) return;
+    recorrer_bucle(h, fin, lider, ACTUALIZAR);
+
+    /* Preheader: s := i MULI a; s := s ADDI c */
+    for (int r = 0; r < num_reducidas; r++) {
+        reducida* red = &reducidas[r];
+        operando i = ivs[red->iv];
+        if (red->a == 1) insertar(h, 0, crear_quad(OP_COPIA, red->s, i, sem_opnd_nulo()));
+        else insertar(h, 0, crear_quad(OP_MULI, red->s, i, sem_opnd_entero((int)red->a)));
+        if (red->c != 0) insertar(h, 0, crear_quad(OP_ADDI, red->s, red->s, sem_opnd_entero((int)red->c)));
+    }
+    bucles_reducidos++;
+}
+
+int opt_reducir_induccion() {
+    int n = sem_num_quads();
+    int* fin_bucle = reservar_ceros(n + 2, sizeof(int));
+    int* cabeceras;
+    int num_bucles = buscar_bucles(n, fin_bucle, &cabeceras);
+    if (num_bucles == 0) {
+        free(cabeceras);
+        free(fin_bucle);
+        return 0;
+    }
+
+    char* lider = calcular_lideres(n);
+    num_formas = sem_num_temporales() + 1;
+    formas = reservar_ceros(num_formas, sizeof(forma_lineal));
+    marca_bloque = 0;
+
+    for (int b = 0; b < num_bucles; b++) {
+        reducir_bucle(cabeceras[b], fin_bucle[cabeceras[b]], lider);
+    }
+    int insertados = aplicar_inserciones(fin_bucle, NULL);
+
+    free(formas);
+    formas = NULL;
+    free(lider);
+    free(cabeceras);
+    free(fin_bucle);
+
+    /* Las copias t := s se propagan y los temporales que quedan muertos
+       (el antiguo i MULI 4) desaparecen con una vuelta de numeración */
+    if (insertados == 0) return 0;
+    return opt_numerar_valores() - insertados;
+}
+
+static void informe_induccion(FILE* out) {
+    fprintf(out, "inducción: %d multiplicaciones reducidas en %d bucles\n",
+            multiplicaciones_reducidas, bucles_reducidos);
+}
+
+/* --- HUECOS PARA LOS TEMPORALES --- */
+
+/* Resultado de la última asignación (para el informe) */
+static _Thread_local int temporales_antes = 0;
+static _Thread_local int huecos_enteros = 0;
+static _Thread_local int huecos_reales = 0;
+
+/* Primera y última aparición de cada temporal. En cada quad se anotan
+   antes los operandos que el resultado: así def[t] solo queda a 1 si la
+   primera aparición es una definición que no lee el valor anterior. */
+static void anotar_aparicion(int* primera, int* ultima, int* tipo, char* def,
+                             const operando* o, int pos, int es_def) {
+    if (o->clase != OPND_TEMP) return;
+    int t = o->u.temp;
+    if (!primera[t]) {
+        primera[t] = pos;
+        tipo[t] = o->tipo;
+        def[t] = es_def;
+    }
+    ultima[t] = pos;
+}
+
+/* Ordena los temporales usados por clave[t] (ordenación por cuentas) */
+static void ordenar_por(const int* clave, const int* usados, int num_usados, int n, int* orden) {
+    int* cuenta = reservar_ceros(n + 2, sizeof(int));
+    for (int k = 0; k < num_usados; k++) cuenta[clave[usados[k]] + 1]++;
+    for (int i = 1; i <= n + 1; i++) cuenta[i] += cuenta[i - 1];
+    for (int k = 0; k < num_usados; k++) orden[cuenta[clave[usados[k]]]++] = usados[k];
+    free(cuenta);
+}
+
+/* Liveness por intervalos + linear scan. El intervalo de un temporal va de
+   su primera a su última aparición. Si todas están en un mismo bloque
+   básico y la primera es una definición, el intervalo es exacto. Si no, y
+   un bucle (salto hacia atrás t <- j) lo corta, se amplía hasta cubrir el
+   bucle entero, porque el valor puede seguir vivo al dar la vuelta. Dos
+   temporales del mismo tipo cuyos intervalos no se solapan comparten hueco. */
+int opt_asignar_huecos() {
+    int n = sem_num_quads();
+    int T = sem_num_temporales();
+    int* primera = reservar_ceros(T + 1, sizeof(int));
+    int* ultima = reservar_ceros(T + 1, sizeof(int));
+    int* tipo = reservar_ceros(T + 1, sizeof(int));
+    char* def = reservar_ceros(T + 1, 1);
+
+    /* bloque[i]: líder del bloque básico del quad i */
+    char* lider = calcular_lideres(n);
+    int* bloque = reservar_ceros(n + 2, sizeof(int));
+    for (int i = 1; i <= n; i++) bloque[i] = lider[i] ? i : bloque[i - 1];
+    free(lider);
+
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        /* En GUARDA_IDX 'res' es el array (se lee, no se define) */
+        anotar_aparicion(primera, ultima, tipo, def, &q->arg1, i, 0);
+        anotar_aparicion(primera, ultima, tipo, def, &q->arg2, i, 0);
+        anotar_aparicion(primera, ultima, tipo, def, &q->res, i, q->op != OP_GUARDA_IDX);
+    }
+
+    /* max_fin[x]: mayor origen j de un salto hacia atrás con destino <= x
+       min_ini[x]: menor destino t de un salto hacia atrás con origen >= x */
+    int* max_fin = reservar_ceros(n + 2, sizeof(int));
+    int* min_ini = reservar_ceros(n + 2, sizeof(int));
+    for (int x = 0; x <= n + 1; x++) min_ini[x] = n + 1;
+    for (int j = 1; j <= n; j++) {
+        quad* q = sem_quad(j);
+        if (es_salto(q->op) && q->destino >= 1 && q->destino <= j) {
+            if (j > max_fin[q->destino]) max_fin[q->destino] = j;
+            if (q->destino < min_ini[j]) min_ini[j] = q->destino;
+        }
+    }
+    for (int x = 1; x <= n; x++) {
+        if (max_fin[x - 1] > max_fin[x]) max_fin[x] = max_fin[x - 1];
+    }
+    for (int x = n; x >= 1; x--) {
+        if (min_ini[x + 1] < min_ini[x]) min_ini[x] = min_ini[x + 1];
+    }
+
+    int* usados = reservar_ceros(T + 1, sizeof(int));
+    int num_usados = 0;
+    for (int t = 1; t <= T; t++) {
+        if (!primera[t]) continue;
+        usados[num_usados++] = t;
+        if (def[t] && bloque[primera[t]] == bloque[ultima[t]]) continue; /* Local */
+        int a = primera[t], b = ultima[t], cambio = 1;
+        while (cambio) {
+            cambio = 0;
+            if (max_fin[b] > b) { b = max_fin[b]; cambio = 1; }
+            if (min_ini[a] < a) { a = min_ini[a]; cambio = 1; }
+        }
+        primera[t] = a;
+        ultima[t] = b;
+    }
+    free(max_fin);
+    free(min_ini);
+
+    /* Linear scan: se recorren los intervalos por inicio y, antes de
+       asignar uno, se liberan los que acabaron antes de que empiece */
+    int* por_inicio = reservar_ceros(num_usados + 1, sizeof(int));
+    int* por_fin = reservar_ceros(num_usados + 1, sizeof(int));
+    ordenar_por(primera, usados, num_usados, n, por_inicio);
+    ordenar_por(ultima, usados, num_usados, n, por_fin);
+
+    int* hueco = reservar_ceros(T + 1, sizeof(int));
+    int* libres_int = reservar_ceros(num_usados + 1, sizeof(int));
+    int* libres_real = reservar_ceros(num_usados + 1, sizeof(int));
+    int num_libres_int = 0, num_libres_real = 0;
+    int num_huecos = 0, vivos_int = 0, vivos_real = 0;
+    huecos_enteros = huecos_reales = 0;
+
+    for (int k = 0, f = 0; k < num_usados; k++) {
+        int t = por_inicio[k];
+        while (f < num_usados && ultima[por_fin[f]] < primera[t]) {
+            int m = por_fin[f++];
+            if (tipo[m] == T_REAL) { libres_real[num_libres_real++] = hueco[m]; vivos_real--; }
+            else { libres_int[num_libres_int++] = hueco[m]; vivos_int--; }
+        }
+        if (tipo[t] == T_REAL) {
+            hueco[t] = num_libres_real ? libres_real[--num_libres_real] : ++num_huecos;
+            if (++vivos_real > huecos_reales) huecos_reales = vivos_real;
+        } else {
+            hueco[t] = num_libres_int ? libres_int[--num_libres_int] : ++num_huecos;
+            if (++vivos_int > huecos_enteros) huecos_enteros = vivos_int;
+        }
+    }
+    temporales_antes = num_usados;
+
+    for (int i = 1; i <= n; i++) {
+        quad* q = sem_quad(i);
+        if (q->res.clase == OPND_TEMP) q->res.u.temp = hueco[q->res.u.temp];
+        if (q->arg1.clase == OPND_TEMP) q->arg1.u.temp = hueco[q->arg1.u.temp];
+        if (q->arg2.clase == OPND_TEMP) q->arg2.u.temp = hueco[q->arg2.u.temp];
+    }
+
+    free(libres_real);
+    free(libres_int);
+    free(hueco);
+    free(por_fin);
+    free(por_inicio);
+    free(usados);
+    free(bloque);
+    free(def);
+    free(tipo);
+    free(ultima);
+    free(primera);
+    return 0; /* No borra quads */
+}
+
+static void informe_huecos(FILE* out) {
+    fprintf(out, "temporales: %d -> %d huecos (vivos a la vez como máximo: %d enteros, %d reales)\n",
+            temporales_antes, huecos_enteros + huecos_reales, huecos_enteros, huecos_reales);
+}
+
+/* --- GESTOR DE PASADAS --- */
+
+typedef struct {
+    const char* nombre;
+    const char* descripcion;
+    int nivel;              /* Primer nivel -O en el que está activa */
+    int (*ejecutar)();      /* NULL: se aplica durante la generación */
+    size_t bandera;         /* Si es de generación: campo de sem_opciones que la controla */
+    void (*informe)(FILE*); /* Datos propios para --pass-stats (opcional) */
+} pasada;
+
+/* Lo que ha hecho cada pasada en la compilación en curso (del hilo) */
+typedef struct {
+    int ejecuciones;
+    long eliminados;
+    double ms;
+} uso_pasada;
+
+/* Registro de pasadas, en orden de ejecución */
+static const pasada pasadas[] = {
+    { "plegado",      "plegado de constantes al generar",     1, NULL, offsetof(opciones_sem, plegar) },
+    { "desenrollado", "desenrollado completo de repeat/for con límites literales", 1, NULL,
+      offsetof(opciones_sem, desenrollar) },
+    { "desenrollado_parcial", "desenrollado por un factor k con bucle de resto", 2, NULL,
+      offsetof(opciones_sem, desenrollar_parcial) },
+    { "inalcanzable", "borrado de código inalcanzable",       1, opt_eliminar_inalcanzable },
+    { "valores",      "numeración de valores local",          1, opt_numerar_valores },
+    { "saltos",       "enhebrado y simplificación de saltos", 1, opt_optimizar_saltos },
+    { "invariantes",  "movimiento de código invariante fuera de los bucles", 2, opt_mover_invariantes, 0,
+      informe_invariantes },
+    { "induccion",    "reducción de fuerza en variables de inducción", 2, opt_reducir_induccion, 0,
+      informe_induccion },
+    { "temporales",   "reutilización de temporales (linear scan)", 2, opt_asignar_huecos, 0,
+      informe_huecos },
+};
+
+#define NUM_PASADAS ((int)(sizeof(pasadas) / sizeof(pasadas[0])))
+#define NIVEL_MAXIMO 2
+
+/* Opciones de la compilación del hilo (opt_aplicar) */
+static _Thread_local char activa[NUM_PASADAS];
+static _Thread_local int mostrar_estadisticas = 0;
+
+static _Thread_local uso_pasada usos[NUM_PASADAS];
+static _Thread_local int quads_iniciales = 0;
+
+void opt_fijar_nivel(opciones_opt* op, int nivel) {
+    op->nivel = nivel;
+    op->pasadas = 0;
+}
+
+int opt_seleccionar(opciones_opt* op, const char* lista) {
+    unsigned mascara = 0;
+    const char* p = lista;
+    while (*p) {
+        const char* fin = strchr(p, ',');
+        size_t len = fin ? (size_t)(fin - p) : strlen(p);
+        int encontrada = 0;
+        for (int i = 0; i < NUM_PASADAS; i++) {
+            if (strlen(pasadas[i].nombre) == len && strncmp(pasadas[i].nombre, p, len) == 0) {
+                mascara |= 1u << i;
+                encontrada = 1;
+            }
+        }
+        if (!encontrada && len > 0) {
+            fprintf(stderr, "Error: Pasada desconocida '%.*s'\n", (int)len, p);
+            return 0;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    op->nivel = -1;
+    op->pasadas = mascara;
+    return 1;
+}
+
+static int esta_activa(const opciones_opt* op, int i) {
+    return op->nivel >= 0 ? op->nivel >= pasadas[i].nivel : (op->pasadas >> i) & 1;
+}
+
+void opt_aplicar(const opciones_opt* op) {
+    for (int i = 0; i < NUM_PASADAS; i++) {
+        activa[i] = esta_activa(op, i);
+        if (!pasadas[i].ejecutar) *(int*)((char*)&sem_opciones + pasadas[i].bandera) = activa[i];
+    }
+    mostrar_estadisticas = op->estadisticas;
+    sem_opciones.max_iteraciones = op->max_iteraciones;
+    sem_opciones.max_quads = op->max_quads;
+    sem_opciones.factor = op->factor;
+}
+
+/* Valor numérico de una opción "--nombre=N" (N >= minimo) */
+static int leer_valor(const char* texto, int minimo, int* destino) {
+    char* fin;
+    errno = 0;
+    long v = strtol(texto, &fin, 10);
+    if (*texto == '\0' || *fin != '\0' || errno || v < minimo || v > INT_MAX) {
+        fprintf(stderr, "Error: Valor no válido '%s' (mínimo %d)\n", texto, minimo);
+        return -1;
+    }
+    *destino = (int)v;
+    return 1;
+}
+
+int opt_procesar_opcion(opciones_opt* op, const char* arg) {
+    if (arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '0' + NIVEL_MAXIMO && !arg[3]) {
+        opt_fijar_nivel(op, arg[2] - '0');
+        return 1;
+    }
+    if (strncmp(arg, "--passes=", 9) == 0) {
+        return opt_seleccionar(op, arg + 9) ? 1 : -1;
+    }
+    if (strcmp(arg, "--pass-stats") == 0) {
+        op->estadisticas = 1;
+        return 1;
+    }
+    if (strncmp(arg, "--unroll-iters=", 15) == 0) {
+        return leer_valor(arg + 15, 0, &op->max_iteraciones);
+    }
+    if (strncmp(arg, "--unroll-size=", 14) == 0) {
+        return leer_valor(arg + 14, 0, &op->max_quads);
+    }
+    if (strncmp(arg, "--unroll-factor=", 16) == 0) {
+        return leer_valor(arg + 16, 2, &op->factor);
+    }
+    return 0;
+}
+
+void opt_ayuda(FILE* out) {
+    const opciones_opt por_defecto = OPT_OPCIONES_POR_DEFECTO;
+    fprintf(out, "  -O0 | -O1 | -O2     nivel de optimización (por defecto -O%d)\n", OPT_NIVEL_POR_DEFECTO);
+    fprintf(out, "  --passes=p1,p2,...  activa solo esas pasadas\n");
+    fprintf(out, "  --pass-stats        estadísticas de cada pasada por stderr\n");
+    fprintf(out, "  --unroll-iters=N    máximo de iteraciones a desenrollar del todo (%d)\n", por_defecto.max_iteraciones);
+    fprintf(out, "  --unroll-size=N     máximo de quads del cuerpo desenrollado (%d)\n", por_defecto.max_quads);
+    fprintf(out, "  --unroll-factor=K   copias por vuelta del desenrollado parcial (%d)\n", por_defecto.factor);
+    fprintf(out, "  Pasadas:\n");
+    for (int i = 0; i < NUM_PASADAS; i++) {
+        fprintf(out, "    %-20s -O%d  %s\n", pasadas[i].nombre, pasadas[i].nivel, pasadas[i].descripcion);
+    }
+}
+
+static double ahora_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+const char* opt_pasada_global_activa(const opciones_opt* op) {
+    for (int i = 0; i < NUM_PASADAS; i++) {
+        if (esta_activa(op, i) && pasadas[i].ejecutar) return pasadas[i].nombre;
+    }
+    return NULL;
+}
+
+void opt_ejecutar_pasadas() {
+    /* Los datos del informe son de este programa (el hilo puede haber compilado otros) */
+    memset(usos, 0, sizeof(usos));
+    quads_movidos = bucles_reducidos = multiplicaciones_reducidas = 0;
+    quads_iniciales = sem_num_quads();
+    for (int i = 0; i < NUM_PASADAS; i++) {
+        const pasada* p = &pasadas[i];
+        uso_pasada* u = &usos[i];
+        if (!activa[i] || !p->ejecutar) continue;
+        double t0 = ahora_ms();
+        int antes = sem_num_quads();
+        int fase = est_empezar_fase(p->nombre);     /* --stats: cada pasada es una fase */
+        u->eliminados += p->ejecutar();
+        est_terminar_fase(fase);
+        u->ms += ahora_ms() - t0;
+        TRAZA(TRAZA_PASADAS, 0, p->nombre, antes, sem_num_quads());
+        u->ejecuciones++;
+    }
+    if (mostrar_estadisticas) opt_imprimir_estadisticas(stderr);
+}
+
+void opt_imprimir_estadisticas(FILE* out) {
+    flockfile(out);
+    fprintf(out, "--- Pasadas de optimización ---\n");
+    fprintf(out, "%-20s %-8s %12s %10s\n", "pasada", "estado", "eliminados", "ms");
+    for (int i = 0; i < NUM_PASADAS; i++) {
+        const pasada* p = &pasadas[i];
+        uso_pasada* u = &usos[i];
+        if (!p->ejecutar) {
+            fprintf(out, "%-20s %-8s %12s %10s\n", p->nombre, activa[i] ? "activa" : "-", "(generación)", "");
+        } else if (u->ejecuciones) {
+            fprintf(out, "%-20s %-8s %12ld %10.3f\n", p->nombre, "activa", u->eliminados, u->ms);
+        } else {
+            fprintf(out, "%-20s %-8s %12s %10s\n", p->nombre, "-", "", "");
+        }
+    }
+    fprintf(out, "quads: %d -> %d\n", quads_iniciales, sem_num_quads());
+    for (int i = 0; i < NUM_PASADAS; i++) {
+        if (usos[i].ejecuciones && pasadas[i].informe) pasadas[i].informe(out);
+    }
+    funlockfile(out);
+}
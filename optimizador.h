@@ -0,0 +1,86 @@
+#ifndef OPTIMIZADOR_H
+#define OPTIMIZADOR_H
+
+#include <stdio.h>
+
+/* Pasadas de optimización sobre los quads ya emitidos (después del parse,
+   con todos los saltos rellenados y antes de sem_finalizar_salida).
+   Cada pasada devuelve el número de quads que ha eliminado. */
+
+// Borra los quads a los que no se llega desde el quad 1 (código tras un
+// break o un GOTO, ramas de una condición constante...)
+int opt_eliminar_inalcanzable();
+
+// Saltos: enhebra cadenas de GOTO, convierte "IF c GOTO i+2; GOTO y" en
+// "IF not c GOTO y", resuelve los IF entre literales y borra los saltos
+// al quad siguiente
+int opt_optimizar_saltos();
+
+// Numeración de valores local: dentro de cada bloque básico reutiliza
+// expresiones y cargas ya calculadas, propaga copias y constantes y
+// elimina los temporales que quedan sin usar.
+int opt_numerar_valores();
+
+// Código invariante: los cálculos de un bucle que dan lo mismo en todas
+// las vueltas (y no pueden fallar) se hacen una vez en un preheader.
+int opt_mover_invariantes();
+
+// Reducción de fuerza: en los bucles, las multiplicaciones a·i + b de una
+// variable de inducción (iterador de for, contador de repeat...) pasan a
+// ser variables nuevas que se incrementan junto a i. Añade quads.
+int opt_reducir_induccion();
+
+// Reparte los temporales en huecos reutilizables (análisis de vida por
+// intervalos y linear scan, un conjunto de huecos por tipo). Debe ir la
+// última: después de ella un $tNN ya no tiene una única definición.
+int opt_asignar_huecos();
+
+// Borra los quads con borrar[i] != 0 (i = 1..sem_num_quads()), renumera
+// el resto y redirige cada salto a un quad borrado al siguiente que queda.
+int opt_compactar(const char* borrar);
+
+// --- GESTOR DE PASADAS ---
+
+// Opciones del optimizador para una compilación
+typedef struct {
+    int nivel;              // -O: activa las pasadas hasta ese nivel (-1: las de 'pasadas')
+    unsigned pasadas;       // --passes: bit i = pasada i del registro
+    int estadisticas;       // --pass-stats
+    int max_iteraciones;    // --unroll-iters
+    int max_quads;          // --unroll-size
+    int factor;             // --unroll-factor
+} opciones_opt;
+
+#define OPT_NIVEL_POR_DEFECTO 1
+#define OPT_OPCIONES_POR_DEFECTO \
+    { .nivel = OPT_NIVEL_POR_DEFECTO, .max_iteraciones = 5, .max_quads = 512, .factor = 4 }
+
+// Trata una opción de la línea de comandos (-O0/-O1/-O2, --passes=...,
+// --pass-stats, --unroll-*) cambiando 'op'. Devuelve 1 si era suya, 0 si
+// no, -1 si es errónea.
+int opt_procesar_opcion(opciones_opt* op, const char* arg);
+
+// Activa las pasadas del nivel indicado (y desactiva el resto)
+void opt_fijar_nivel(opciones_opt* op, int nivel);
+
+// Activa solo las pasadas de la lista "p1,p2,..." (0 si alguna no existe)
+int opt_seleccionar(opciones_opt* op, const char* lista);
+
+// Usa 'op' en la compilación del hilo (también las opciones de generación
+// de sem_opciones). Antes del parse.
+void opt_aplicar(const opciones_opt* op);
+
+// Ejecuta en orden las pasadas activas (tras el parse, antes de imprimir)
+void opt_ejecutar_pasadas();
+
+// Primera pasada activa en 'op' que trabaja sobre el programa completo (las
+// que no son de generación), o NULL si no hay ninguna
+const char* opt_pasada_global_activa(const opciones_opt* op);
+
+// Tabla de pasadas con quads eliminados y tiempo de cada una
+void opt_imprimir_estadisticas(FILE* out);
+
+// Descripción de las opciones y de las pasadas registradas
+void opt_ayuda(FILE* out);
+
+#endif
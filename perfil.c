@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "perfil.h"
+#include "semantica.h"
+
+#define ANCHO_BARRA 40      /* Caracteres de la barra más larga del histograma */
+
+/* --- CREACIÓN --- */
+
+static void* reservar_ceros(size_t num, size_t tam) {
+    void* p = calloc(num ? num : 1, tam);
+    if (!p) {
+        fprintf(stderr, "Error fatal: Sin memoria para el perfil\n");
+        exit(1);
+    }
+    return p;
+}
+
+static int es_condicional(const quad* q) {
+    return q->op == OP_IFI || q->op == OP_IFF;
+}
+
+perfil* perf_crear() {
+    perfil* p = reservar_ceros(1, sizeof(perfil));
+    int n = sem_num_quads();
+    p->num_quads = n;
+    p->ejecuciones = reservar_ceros(n + 1, sizeof(unsigned long long));
+    p->tomados = reservar_ceros(n + 1, sizeof(unsigned long long));
+    p->bucle_en = reservar_ceros(n + 1, sizeof(int));
+
+    /* Un bucle por cada quad al que se salta hacia atrás; su cuerpo llega
+       hasta el último salto que vuelve a él */
+    int* fin = reservar_ceros(n + 1, sizeof(int));
+    for (int j = 1; j <= n; j++) {
+        const quad* q = sem_quad(j);
+        if ((es_condicional(q) || q->op == OP_GOTO) && q->destino >= 1 && q->destino <= j) {
+            if (j > fin[q->destino]) fin[q->destino] = j;
+        }
+    }
+    for (int h = 1; h <= n; h++) {
+        if (fin[h]) p->num_bucles++;
+    }
+    p->bucles = reservar_ceros(p->num_bucles, sizeof(bucle_perfil));
+    int b = 0;
+    for (int h = 1; h <= n; h++) {
+        p->bucle_en[h] = -1;
+        if (!fin[h]) continue;
+        p->bucles[b].cabecera = h;
+        p->bucles[b].fin = fin[h];
+        p->bucle_en[h] = b++;
+    }
+    free(fin);
+    return p;
+}
+
+void perf_liberar(perfil* p) {
+    if (!p) return;
+    free(p->ejecuciones);
+    free(p->tomados);
+    free(p->bucle_en);
+    free(p->bucles);
+    free(p);
+}
+
+/* --- DURANTE LA EJECUCIÓN --- */
+
+static int tramo(unsigned long long vueltas) {
+    int t = 0;
+    while (vueltas > 1 && t < PERF_TRAMOS - 1) {
+        vueltas >>= 1;
+        t++;
+    }
+    return t;
+}
+
+/* Se sale del bucle (o se vuelve a entrar desde fuera): se apunta la entrada */
+static void cerrar_entrada(bucle_perfil* b) {
+    if (!b->vueltas) return;
+    b->histograma[tramo(b->vueltas)]++;
+    b->total_vueltas += b->vueltas;
+    b->vueltas = 0;
+}
+
+void perf_paso(perfil* p, int quad, int anterior) {
+    if (quad < 1 || quad > p->num_quads) return;  /* HALT final o salto roto */
+    p->ejecuciones[quad]++;
+
+    /* Un IF seguido de algo que no es el quad siguiente ha saltado */
+    if (anterior >= 1 && quad != anterior + 1 && es_condicional(sem_quad(anterior))) p->tomados[anterior]++;
+
+    if (p->bucle_en[quad] >= 0) {
+        bucle_perfil* b = &p->bucles[p->bucle_en[quad]];
+        if (b->vueltas && anterior >= b->cabecera && anterior <= b->fin) {
+            b->vueltas++;
+        } else {
+            cerrar_entrada(b);
+            b->vueltas = 1;
+            b->entradas++;
+        }
+    }
+}
+
+/* --- INFORME --- */
+
+static void informe_listado(perfil* p, FILE* out) {
+    fputs("--- Listado C3A anotado (ejecuciones, línea del fuente) ---\n", out);
+    for (int i = 1; i <= p->num_quads; i++) {
+        const quad* q = sem_quad(i);
+        if (p->ejecuciones[i]) fprintf(out, "%12llu", p->ejecuciones[i]);
+        else fprintf(out, "%12s", "-");
+        if (q->linea) fprintf(out, " %5d  ", q->linea);
+        else fprintf(out, " %5s  ", "-");
+        fprintf(out, "%d: ", i);
+        sem_imprimir_quad(out, i);
+        if (es_condicional(q) && p->ejecuciones[i]) {
+            fprintf(out, "    [salta %llu de %llu, %.1f%%]", p->tomados[i], p->ejecuciones[i],
+                    100.0 * (double)p->tomados[i] / (double)p->ejecuciones[i]);
+        }
+        fputc('\n', out);
+    }
+}
+
+/* Quads ejecutados por línea; con el fuente se imprime cada línea con su
+   texto (hasta la última con código, aunque esté después del final del
+   fichero, como el HALT), sin él solo las que han generado código. Los
+   quads sin línea van al final: así la columna suma todos los ejecutados. */
+static void informe_lineas(perfil* p, FILE* out, const char* fuente) {
+    int max_linea = 0;
+    for (int i = 1; i <= p->num_quads; i++) {
+        if (sem_quad(i)->linea > max_linea) max_linea = sem_quad(i)->linea;
+    }
+    unsigned long long* por_linea = reservar_ceros(max_linea + 1, sizeof(unsigned long long));
+    char* con_codigo = reservar_ceros(max_linea + 1, 1);
+    for (int i = 1; i <= p->num_quads; i++) {
+        int l = sem_quad(i)->linea;
+        por_linea[l] += p->ejecuciones[i];
+        con_codigo[l] = 1;
+    }
+
+    fputs("--- Quads ejecutados por línea del fuente ---\n", out);
+    FILE* f = fuente ? fopen(fuente, "r") : NULL;
+    if (f) {
+        int c = fgetc(f);
+        for (int l = 1; c != EOF || l <= max_linea; l++) {
+            if (l <= max_linea && con_codigo[l]) fprintf(out, "%12llu | %5d: ", por_linea[l], l);
+            else fprintf(out, "%12s | %5d: ", "", l);
+            while (c != EOF && c != '\n') {
+                fputc(c, out);
+                c = fgetc(f);
+            }
+            fputc('\n', out);
+            if (c == '\n') c = fgetc(f);
+        }
+        fclose(f);
+    } else {
+        for (int l = 1; l <= max_linea; l++) {
+            if (con_codigo[l]) fprintf(out, "%12llu | %5d\n", por_linea[l], l);
+        }
+    }
+    if (con_codigo[0]) fprintf(out, "%12llu | %5s\n", por_linea[0], "-");
+    free(por_linea);
+    free(con_codigo);
+}
+
+static void informe_bucles(perfil* p, FILE* out) {
+    fputs("--- Bucles (vueltas: veces que se ejecuta la cabecera en cada entrada) ---\n", out);
+    if (!p->num_bucles) fputs("(ninguno)\n", out);
+    for (int k = 0; k < p->num_bucles; k++) {
+        bucle_perfil* b = &p->bucles[k];
+        cerrar_entrada(b);
+        int primera = 0, ultima = 0;
+        for (int i = b->cabecera; i <= b->fin; i++) {
+            int l = sem_quad(i)->linea;
+            if (l && (!primera || l < primera)) primera = l;
+            if (l > ultima) ultima = l;
+        }
+        fprintf(out, "Quads %d-%d (líneas %d-%d): ", b->cabecera, b->fin, primera, ultima);
+        if (!b->entradas) {
+            fputs("no se ejecuta\n", out);
+            continue;
+        }
+        fprintf(out, "%llu entradas, %llu vueltas (media %.1f)\n", b->entradas, b->total_vueltas,
+                (double)b->total_vueltas / (double)b->entradas);
+
+        unsigned long long max = 0;
+        for (int t = 0; t < PERF_TRAMOS; t++) {
+            if (b->histograma[t] > max) max = b->histograma[t];
+        }
+        for (int t = 0; t < PERF_TRAMOS; t++) {
+            char rango[32];
+            unsigned long long desde = 1ULL << t;
+            if (!b->histograma[t]) continue;
+            if (t == PERF_TRAMOS - 1) snprintf(rango, sizeof(rango), "%llu+", desde);
+            else if (t == 0) snprintf(rango, sizeof(rango), "1");
+            else snprintf(rango, sizeof(rango), "%llu-%llu", desde, 2 * desde - 1);
+            fprintf(out, "    %12s %12llu ", rango, b->histograma[t]);
+            int ancho = (int)((b->histograma[t] * ANCHO_BARRA + max - 1) / max);
+            for (int c = 0; c < ancho; c++) fputc('#', out);
+            fputc('\n', out);
+        }
+    }
+}
+
+void perf_informe(perfil* p, FILE* out, const char* fuente) {
+    fputs("=== PERFIL DE EJECUCIÓN ===\n", out);
+    informe_listado(p, out);
+    informe_lineas(p, out, fuente);
+    informe_bucles(p, out);
+}
@@ -0,0 +1,45 @@
+#ifndef PERFIL_H
+#define PERFIL_H
+
+#include <stdio.h>
+
+/* Perfil de una ejecución en la máquina virtual (--profile): cuántas veces
+   se ejecuta cada quad, cuántas salta cada IF y cuántas vueltas da cada
+   bucle por entrada. Se crea sobre los quads ya optimizados, la VM lo
+   rellena y el informe se imprime antes de liberar el buffer. */
+
+#define PERF_TRAMOS 16      // Histograma de vueltas: 1, 2-3, 4-7... 2^15 o más
+
+// Bucle: un salto hacia atrás desde fin (o antes) hasta la cabecera
+typedef struct {
+    int cabecera;
+    int fin;                                // Último quad que salta a la cabecera
+    unsigned long long vueltas;             // Cabecera ejecutada en la entrada actual
+    unsigned long long entradas;
+    unsigned long long total_vueltas;
+    unsigned long long histograma[PERF_TRAMOS];
+} bucle_perfil;
+
+typedef struct {
+    int num_quads;
+    unsigned long long* ejecuciones;        // [1..num_quads]
+    unsigned long long* tomados;            // IF que saltan, [1..num_quads]
+    int* bucle_en;                          // Bucle con cabecera en el quad, o -1
+    bucle_perfil* bucles;
+    int num_bucles;
+} perfil;
+
+// Contadores a cero para los quads 1..sem_num_quads() y sus bucles
+perfil* perf_crear();
+
+// La VM lo llama con cada quad que ejecuta y el anterior (0 al empezar)
+void perf_paso(perfil* p, int quad, int anterior);
+
+// Listado C3A anotado con las ejecuciones de cada quad y los saltos tomados,
+// las ejecuciones por línea del fuente (con su texto si 'fuente' se puede
+// leer) y el histograma de vueltas de cada bucle
+void perf_informe(perfil* p, FILE* out, const char* fuente);
+
+void perf_liberar(perfil* p);
+
+#endif
@@ -1,132 +1,524 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
+#include <limits.h>
+#include <math.h>
 #include "semantica.h"
+#include "arena.h"
+#include "estadisticas.h"
+#include "traza.h"
 
-#define MAX_INSTRUCCIONES 10000
-#define TAM_BUFFER 256
+/* Buffer de instrucciones en memoria, repartido en trozos.
+   El trozo k guarda (1 << (LOG_TROZO_MIN + k)) quads hasta llegar a
+   (1 << LOG_TROZO_MAX); a partir de ahí todos los trozos tienen ese tamaño.
+   Los trozos nunca se mueven, así que el número de un quad es estable
+   (backpatching) y añadir es O(1) sin recolocar nada. */
+#define LOG_TROZO_MIN 8                                  /* 256 quads */
+#define LOG_TROZO_MAX 16                                 /* 65536 quads */
+#define TROZOS_CRECIENTES (LOG_TROZO_MAX - LOG_TROZO_MIN + 1)
+#define LIMITE_CRECIENTE ((1 << (LOG_TROZO_MAX + 1)) - (1 << LOG_TROZO_MIN))
 
-/* Buffer de instrucciones en memoria */
-static char* instrucciones[MAX_INSTRUCCIONES];
-static int sig_instruccion = 1; /* Empieza en 1 */
-static int contador_temporales = 1;
+/* Todo el estado de la compilación es de hilo (_Thread_local): cada hilo
+   compila un programa cada vez (ver sem_reiniciar) */
+static _Thread_local quad** trozos = NULL;     /* Directorio de trozos (crece x2) */
+static _Thread_local int num_trozos = 0;
+static _Thread_local int cap_trozos = 0;
+static _Thread_local int capacidad = 0;        /* Quads que caben en los trozos reservados */
+static _Thread_local int sig_instruccion = 1; /* Empieza en 1 */
+static _Thread_local int contador_temporales = 1;
 
-// variables pila para switch (hasta 10 anidados)
-static char* switch_stack[10];
-static int switch_top = 0; // índice tope de la pila
+/* Salida continua (--stream): los quads que ya no pueden cambiar se
+   imprimen y sus trozos se liberan mientras se sigue generando */
+static _Thread_local FILE* salida_continua = NULL;  /* NULL: todo se imprime al final */
+static _Thread_local int volcados = 1;              /* Primer quad sin imprimir */
+static _Thread_local int trozos_sin_volcar = 0;     /* Reservados desde el último volcado */
+static _Thread_local int primer_trozo = 0;          /* Los anteriores ya están liberados */
+static _Thread_local int* regiones = NULL;          /* Inicios de las regiones abiertas */
+static _Thread_local int num_regiones = 0;
+static _Thread_local int cap_regiones = 0;
 
-// variables pila para break (hasta 20 anidados)
-static lista_nodos* break_list_stack[20];
-static int break_list_top = 0;   // índice tope de la pila */
+_Thread_local int linea_token = 1;
 
-// variabes para loop unrolling
-static int recording = 0;
-static char code_buffer[4096];     // buffer para guardar cuerpo bucle limitado a 4KB
+_Thread_local opciones_sem sem_opciones = {
+    .plegar = 1,
+    .desenrollar = 1,
+    .desenrollar_parcial = 0,
+    .max_iteraciones = 5,
+    .max_quads = 512,
+    .factor = 4
+};
+
+// Caso de un switch: valor de la etiqueta y primer quad de su cuerpo
+typedef struct {
+    int valor;
+    int etiqueta;
+} caso_switch;
+
+typedef struct {
+    atributos var;          // Valor que se compara
+    int inicio;             // Primer quad de los cuerpos
+    int etiqueta_default;   // 0 = sin default
+    caso_switch* casos;     // En el orden del fuente
+    int num_casos;
+    int cap_casos;
+} info_switch;
+
+// variables pila para switch (crece al doble: sin límite de anidamiento)
+static _Thread_local info_switch* switch_stack = NULL;
+static _Thread_local int switch_top = 0; // índice tope de la pila
+static _Thread_local int cap_switch = 0;
+
+// variables pila para break (una capa por bucle o switch abierto; crece igual)
+static _Thread_local lista_nodos** break_list_stack = NULL;
+static _Thread_local int break_list_top = 0;   // índice tope de la pila */
+static _Thread_local int cap_break = 0;
+
+/* Nombres de los códigos de operación tal y como se imprimen */
+static const char* nombres_op[] = {
+    [OP_ADDI] = "ADDI", [OP_ADDF] = "ADDF",
+    [OP_SUBI] = "SUBI", [OP_SUBF] = "SUBF",
+    [OP_MULI] = "MULI", [OP_MULF] = "MULF",
+    [OP_DIVI] = "DIVI", [OP_DIVF] = "DIVF",
+    [OP_MODI] = "MODI", [OP_POW]  = "POW",
+    [OP_CHSI] = "CHSI", [OP_CHSF] = "CHSF",
+    [OP_I2F]  = "I2F"
+};
+static const char* nombres_rel[] = { "EQ", "NE", "LT", "LE", "GT", "GE" };
+
+/* --- OPERANDOS --- */
+
+operando sem_opnd_nulo() {
+    operando o;
+    o.clase = OPND_NULO;
+    o.tipo = T_ERROR;
+    o.u.valor_int = 0;
+    return o;
+}
+
+operando sem_opnd_var(const char* nombre, int tipo) {
+    operando o;
+    o.clase = OPND_VAR;
+    o.tipo = tipo;
+    o.u.nombre = nombre;
+    return o;
+}
+
+operando sem_opnd_temp(int numero, int tipo) {
+    operando o;
+    o.clase = OPND_TEMP;
+    o.tipo = tipo;
+    o.u.temp = numero;
+    return o;
+}
+
+operando sem_opnd_entero(int valor) {
+    operando o;
+    o.clase = OPND_ENTERO;
+    o.tipo = T_ENTERO;
+    o.u.valor_int = valor;
+    return o;
+}
+
+operando sem_opnd_real(float valor) {
+    operando o;
+    o.clase = OPND_REAL;
+    o.tipo = T_REAL;
+    o.u.valor_float = valor;
+    return o;
+}
 
 /* --- GESTIÓN DEL BUFFER DE CÓDIGO --- */
 
+static int log2_entero(unsigned x) {
+#ifdef __GNUC__
+    return 31 - __builtin_clz(x);
+#else
+    int r = 0;
+    while (x >>= 1) r++;
+    return r;
+#endif
+}
+
+/* Dirección del quad número i (0 <= i < capacidad) */
+static quad* quad_en(int i) {
+    if (i < LIMITE_CRECIENTE) {
+        unsigned x = (unsigned)i + (1u << LOG_TROZO_MIN);
+        int k = log2_entero(x);
+        return &trozos[k - LOG_TROZO_MIN][x - (1u << k)];
+    }
+    i -= LIMITE_CRECIENTE;
+    return &trozos[TROZOS_CRECIENTES + (i >> LOG_TROZO_MAX)][i & ((1 << LOG_TROZO_MAX) - 1)];
+}
+
+/* Reserva un trozo más al final */
+static void nuevo_trozo() {
+    int log_tam = LOG_TROZO_MIN + num_trozos;
+    if (log_tam > LOG_TROZO_MAX) log_tam = LOG_TROZO_MAX;
+
+    if (num_trozos == cap_trozos) {
+        cap_trozos = cap_trozos ? cap_trozos * 2 : 16;
+        trozos = realloc(trozos, sizeof(quad*) * cap_trozos);
+        if (!trozos) {
+            fprintf(stderr, "Error fatal: Sin memoria para el buffer de instrucciones\n");
+            exit(1);
+        }
+    }
+    trozos[num_trozos] = malloc(sizeof(quad) << log_tam);
+    if (!trozos[num_trozos]) {
+        fprintf(stderr, "Error fatal: Sin memoria para el buffer de instrucciones\n");
+        exit(1);
+    }
+    num_trozos++;
+    capacidad += 1 << log_tam;
+    trozos_sin_volcar++;
+}
+
 int sem_generar_etiqueta() {
     return sig_instruccion;
 }
-int sem_emitir(const char* fmt, ...) {
-    va_list args;
-    
-    /* modo para loop unrolling (guardando cuerpo bucle) */
-    if (recording) {
-        char temp[1024]; // Buffer temporal local
-        
-        va_start(args, fmt);
-        vsnprintf(temp, 1024, fmt, args);
-        va_end(args);
-        
-        /* Concatenamos al buffer global */
-        if (strlen(code_buffer) + strlen(temp) + 2 < 4096) {
-            strcat(code_buffer, temp);
-            strcat(code_buffer, "\n");
-        } else {
-            fprintf(stderr, "Error: Cuerpo del bucle demasiado grande para unrolling.\n");
-        }
-        
-        return 0; // No cuenta como instrucción emitida
+
+static int escribir_quad(quad q) {
+    if (sig_instruccion >= capacidad) nuevo_trozo();
+
+    *quad_en(sig_instruccion) = q;
+    return sig_instruccion++;
+}
+
+/* Quad generado por el parser (o copiado al desenrollar): cuenta en --stats */
+static int emitir_quad(quad q) {
+    EST_CONTAR(EST_QUADS);
+    return escribir_quad(q);
+}
+
+int sem_emitir(op_c3a op, operando res, operando arg1, operando arg2) {
+    quad q;
+    q.op = op;
+    q.rel = REL_EQ;
+    q.res = res;
+    q.arg1 = arg1;
+    q.arg2 = arg2;
+    q.destino = 0;
+    q.linea = linea_token;
+    return emitir_quad(q);
+}
+
+int sem_emitir_si(op_c3a op, op_rel rel, operando a, operando b, int destino) {
+    quad q;
+    q.op = op;
+    q.rel = rel;
+    q.res = sem_opnd_nulo();
+    q.arg1 = a;
+    q.arg2 = b;
+    q.destino = destino;
+    q.linea = linea_token;
+    return emitir_quad(q);
+}
+
+int sem_emitir_salto(int destino) {
+    return sem_emitir_si(OP_GOTO, REL_EQ, sem_opnd_nulo(), sem_opnd_nulo(), destino);
+}
+
+/* --- ACCESO PARA LAS PASADAS DE OPTIMIZACIÓN --- */
+
+int sem_num_quads() {
+    return sig_instruccion - 1;
+}
+
+quad* sem_quad(int i) {
+    return quad_en(i);
+}
+
+void sem_truncar(int num) {
+    if (num >= 0 && num < sig_instruccion) sig_instruccion = num + 1;
+}
+
+int sem_emitir_quad(quad q) {
+    return escribir_quad(q);
+}
+
+int sem_num_temporales() {
+    return contador_temporales - 1;
+}
+
+/* Única conversión de la representación intermedia a texto */
+static void imprimir_operando(FILE* out, const operando* o) {
+    switch (o->clase) {
+        case OPND_VAR:    fputs(o->u.nombre, out); break;
+        case OPND_TEMP:   fprintf(out, "$t%02d", o->u.temp); break;
+        case OPND_ENTERO: fprintf(out, "%d", o->u.valor_int); break;
+        case OPND_REAL:   fprintf(out, "%.6g", o->u.valor_float); break;
+        case OPND_NULO:   break;
     }
+}
 
-    /* modo normal*/
-    if (sig_instruccion >= MAX_INSTRUCCIONES) {
-        fprintf(stderr, "Error fatal: Programa demasiado grande (max %d lineas)\n", MAX_INSTRUCCIONES);
-        exit(1);
+static void imprimir_quad(FILE* out, const quad* q) {
+    switch (q->op) {
+        case OP_COPIA:
+            imprimir_operando(out, &q->res);
+            fputs(" := ", out);
+            imprimir_operando(out, &q->arg1);
+            break;
+        case OP_CHSI: case OP_CHSF: case OP_I2F:
+            imprimir_operando(out, &q->res);
+            fprintf(out, " := %s ", nombres_op[q->op]);
+            imprimir_operando(out, &q->arg1);
+            break;
+        case OP_CARGA_IDX:
+            imprimir_operando(out, &q->res);
+            fputs(" := ", out);
+            imprimir_operando(out, &q->arg1);
+            fputc('[', out);
+            imprimir_operando(out, &q->arg2);
+            fputc(']', out);
+            break;
+        case OP_GUARDA_IDX:
+            imprimir_operando(out, &q->res);
+            fputc('[', out);
+            imprimir_operando(out, &q->arg1);
+            fputs("] := ", out);
+            imprimir_operando(out, &q->arg2);
+            break;
+        case OP_IFI: case OP_IFF:
+            fputs("IF ", out);
+            imprimir_operando(out, &q->arg1);
+            fprintf(out, " %s%s ", nombres_rel[q->rel], q->op == OP_IFF ? "F" : "I");
+            imprimir_operando(out, &q->arg2);
+            fputs(" GOTO", out);
+            if (q->destino) fprintf(out, " %d", q->destino);
+            break;
+        case OP_GOTO:
+            fputs("GOTO", out);
+            if (q->destino) fprintf(out, " %d", q->destino);
+            break;
+        case OP_GOTO_TABLA:
+            fputs("GOTO TABLA[", out);
+            imprimir_operando(out, &q->arg1);
+            fputs("], ", out);
+            imprimir_operando(out, &q->arg2);
+            break;
+        case OP_PARAM:
+            fputs("PARAM ", out);
+            imprimir_operando(out, &q->arg1);
+            break;
+        case OP_CALL:
+            fputs("CALL ", out);
+            imprimir_operando(out, &q->arg1);
+            fputs(", ", out);
+            imprimir_operando(out, &q->arg2);
+            break;
+        case OP_HALT:
+            fputs("HALT", out);
+            break;
+        default:
+            /* Operaciones binarias: res := arg1 OP arg2 */
+            imprimir_operando(out, &q->res);
+            fputs(" := ", out);
+            imprimir_operando(out, &q->arg1);
+            fprintf(out, " %s ", nombres_op[q->op]);
+            imprimir_operando(out, &q->arg2);
+            break;
     }
+}
 
-    char* buffer = malloc(TAM_BUFFER); 
-    
-    va_start(args, fmt);
-    vsnprintf(buffer, TAM_BUFFER, fmt, args);
-    va_end(args);
+/* Número del primer quad del trozo k */
+static int inicio_trozo(int k) {
+    if (k < TROZOS_CRECIENTES) return (1 << (LOG_TROZO_MIN + k)) - (1 << LOG_TROZO_MIN);
+    return LIMITE_CRECIENTE + ((k - TROZOS_CRECIENTES) << LOG_TROZO_MAX);
+}
 
-    instrucciones[sig_instruccion] = buffer;
-    return sig_instruccion++; 
+/* Imprime los quads desde 'volcados' hasta fin - 1. Recorremos trozo a
+   trozo (cada uno es contiguo en memoria) y liberamos los que quedan
+   impresos enteros. */
+static void volcar_hasta(FILE* out, int fin) {
+    for (int k = primer_trozo; k < num_trozos && volcados < fin; k++) {
+        quad* trozo = trozos[k];
+        int base = inicio_trozo(k);
+        int fin_trozo = inicio_trozo(k + 1);
+        int hasta = fin < fin_trozo ? fin : fin_trozo;
+        for (; volcados < hasta; volcados++) {
+            fprintf(out, "%d: ", volcados);
+            imprimir_quad(out, &trozo[volcados - base]);
+            fputc('\n', out);
+        }
+        if (volcados == fin_trozo) {
+            free(trozo);
+            trozos[k] = NULL;
+            primer_trozo = k + 1;
+        }
+    }
 }
 
 void sem_finalizar_salida(FILE* out) {
     if (!out) out = stdout;
-    for (int i = 1; i < sig_instruccion; i++) {
-        if (instrucciones[i]) {
-            fprintf(out, "%d: %s\n", i, instrucciones[i]);
-            free(instrucciones[i]); // Limpieza
-        }
-    }
+    volcar_hasta(out, sig_instruccion);
+    sem_liberar_codigo();
+}
+
+void sem_imprimir_quad(FILE* out, int i) {
+    imprimir_quad(out, quad_en(i));
+}
+
+void sem_liberar_codigo() {
+    for (int k = primer_trozo; k < num_trozos; k++) free(trozos[k]);
+    free(trozos);
+    trozos = NULL;
+    num_trozos = cap_trozos = capacidad = 0;
+    primer_trozo = 0;
+    volcados = 1;
+    trozos_sin_volcar = 0;
+    free(regiones);
+    regiones = NULL;
+    num_regiones = cap_regiones = 0;
 }
 
 /* --- OPERACIONES DE LISTAS (BACKPATCHING) --- */
 
+/* Los nodos se reservan por bloques y se reciclan en una lista libre
+   cuando sem_backpatch consume la lista que los contenía. */
+#define NODOS_POR_BLOQUE 1024
+
+typedef struct bloque_nodos {
+    struct bloque_nodos *anterior;
+    lista_nodos nodos[NODOS_POR_BLOQUE];
+} bloque_nodos;
+
+static _Thread_local bloque_nodos* bloques_nodos = NULL;
+static _Thread_local lista_nodos* nodos_libres = NULL;
+
+static lista_nodos* nuevo_nodo() {
+    if (!nodos_libres) {
+        bloque_nodos* b = malloc(sizeof(bloque_nodos));
+        if (!b) {
+            fprintf(stderr, "Error fatal: Sin memoria para las listas de backpatching\n");
+            exit(1);
+        }
+        b->anterior = bloques_nodos;
+        bloques_nodos = b;
+        EST_SUMAR(EST_NODOS_RESERVADOS, NODOS_POR_BLOQUE);
+        for (int i = 0; i < NODOS_POR_BLOQUE - 1; i++) {
+            b->nodos[i].siguiente = &b->nodos[i + 1];
+            b->nodos[i].referencia = 0;
+        }
+        b->nodos[NODOS_POR_BLOQUE - 1].referencia = 0;
+        b->nodos[NODOS_POR_BLOQUE - 1].siguiente = NULL;
+        nodos_libres = b->nodos;
+    }
+    lista_nodos* p = nodos_libres;
+    nodos_libres = p->siguiente;
+    return p;
+}
+
 lista_nodos* sem_makelist(int referencia) {
-    lista_nodos* p = malloc(sizeof(lista_nodos));
+    lista_nodos* p = nuevo_nodo();
+    EST_CONTAR(EST_NODOS_LISTA);
     p->referencia = referencia;
     p->siguiente = NULL;
+    p->cola = p;
     return p;
 }
 
 lista_nodos* sem_merge(lista_nodos* l1, lista_nodos* l2) {
     if (!l1) return l2;
     if (!l2) return l1;
-    
-    lista_nodos* p = l1;
-    while (p->siguiente != NULL) {
-        p = p->siguiente;
-    }
-    p->siguiente = l2;
+
+    /* Enganchamos l2 detrás del último nodo de l1 */
+    l1->cola->siguiente = l2;
+    l1->cola = l2->cola;
     return l1;
 }
 
+void sem_liberar_lista(lista_nodos* lista) {
+    if (!lista) return;
+    /* Con salida continua los nodos libres no deben frenar el volcado */
+    if (salida_continua) {
+        for (lista_nodos* p = lista; p; p = p->siguiente) p->referencia = 0;
+    }
+    lista->cola->siguiente = nodos_libres;
+    nodos_libres = lista;
+}
+
 void sem_backpatch(lista_nodos* lista, int etiqueta_destino) {
+    if (!lista) return;
+    EST_CONTAR(EST_BACKPATCH);
     lista_nodos* p = lista;
+    int rellenados = 0;
     while (p != NULL) {
         int ref = p->referencia;
-        if (ref < sig_instruccion && instrucciones[ref] != NULL) {
-            // Asumimos que la instrucción guardada era incompleta (ej: "IF ... GOTO")
-            char nuevo_buffer[TAM_BUFFER];
-            // concatenamos la instrucción original con la etiqueta destino
-            snprintf(nuevo_buffer, TAM_BUFFER, "%s %d", instrucciones[ref], etiqueta_destino);
-            
-            free(instrucciones[ref]);
-            instrucciones[ref] = strdup(nuevo_buffer);
+        /* Una referencia a un quad ya descartado (desenrollado) se ignora */
+        if (ref > 0 && ref < sig_instruccion) {
+            quad_en(ref)->destino = etiqueta_destino;
+            rellenados++;
         }
         p = p->siguiente;
     }
+    EST_SUMAR(EST_HUECOS_RELLENADOS, rellenados);
+    TRAZA(TRAZA_BACKPATCH, linea_token, "backpatch", rellenados, etiqueta_destino);
+    /* Devolvemos la lista entera al pool */
+    sem_liberar_lista(lista);
+}
+
+/* --- SALIDA CONTINUA --- */
+
+void sem_salida_continua(FILE* out) {
+    salida_continua = out;
+}
+
+void sem_abrir_region(int inicio) {
+    if (num_regiones == cap_regiones) {
+        cap_regiones = cap_regiones ? cap_regiones * 2 : 16;
+        regiones = realloc(regiones, sizeof(int) * cap_regiones);
+        if (!regiones) {
+            fprintf(stderr, "Error fatal: Sin memoria para las regiones abiertas\n");
+            exit(1);
+        }
+    }
+    regiones[num_regiones++] = inicio;
+}
+
+/* Las regiones se anidan como las sentencias: se cierra la última abierta */
+static void cerrar_region() {
+    if (num_regiones > 0) num_regiones--;
+}
+
+/* Primer quad que todavía puede cambiar: el de un salto pendiente en
+   alguna lista (truelist, falselist, nextlist, break...) o el inicio de
+   una región que se puede sacar del buffer (cuerpo de un bucle o de un
+   switch, cabecera de un for). Los nodos libres del pool tienen
+   referencia 0. */
+static int marca_volcado() {
+    int marca = sig_instruccion;
+    for (int r = 0; r < num_regiones; r++) {
+        if (regiones[r] < marca) marca = regiones[r];
+    }
+    for (bloque_nodos* b = bloques_nodos; b; b = b->anterior) {
+        for (int i = 0; i < NODOS_POR_BLOQUE; i++) {
+            int ref = b->nodos[i].referencia;
+            if (ref > 0 && ref < marca) marca = ref;
+        }
+    }
+    return marca;
+}
+
+/* Solo entre sentencias: dentro de una, el número de un salto recién
+   emitido puede estar aún en una variable local y no en una lista. El pool
+   se recorre una vez por trozo nuevo, así que el coste se reparte entre
+   todos sus quads. */
+void sem_volcar_terminados() {
+    if (!salida_continua || !trozos_sin_volcar) return;
+    trozos_sin_volcar = 0;
+    volcar_hasta(salida_continua, marca_volcado());
 }
 
 /* --- AUXILIARES Y GESTIÓN DE SÍMBOLOS --- */
 
-char* sem_generar_temporal() {
-    char* temp = malloc(20);
-    sprintf(temp, "$t%02d", contador_temporales++);
-    return temp;
+operando sem_generar_temporal(int tipo) {
+    return sem_opnd_temp(contador_temporales++, tipo);
 }
 
 // Helper interno para devolver struct atributos limpio
-atributos crear_atribs(info_simbolo* s) {
+static atributos crear_atribs(operando dir) {
     atributos a;
-    a.simb = s;
+    a.dir = dir;
     a.truelist = NULL;
     a.falselist = NULL;
     a.nextlist = NULL;
@@ -134,169 +526,381 @@ atributos crear_atribs(info_simbolo* s) {
     return a;
 }
 
-atributos sem_crear_literal(char* valor, int tipo) {
-    info_simbolo* s = malloc(sizeof(info_simbolo));
-    s->nombre = strdup(valor);
-    s->tipo = tipo;
-    s->u.valor_int = 0; 
-    return crear_atribs(s);
+atributos sem_crear_entero(int valor) {
+    return crear_atribs(sem_opnd_entero(valor));
+}
+
+atributos sem_crear_real(float valor) {
+    return crear_atribs(sem_opnd_real(valor));
 }
 
 /* Función para crear un temporal "vacío" (usada en bucles para contadores) */
 atributos sem_crear_temporal(int tipo) {
-    /* 1. Obtenemos un nombre nuevo ($tXX) usando función existente */
-    char* nombre = sem_generar_temporal();
-    
-    /* 2. Empaquetamos en la estructura 'atributos' usando función existente */
-    /* Aunque se llame 'literal', sirve para crear la estructura del símbolo */
-    return sem_crear_literal(nombre, tipo);
+    return crear_atribs(sem_generar_temporal(tipo));
+}
+
+/* Símbolo enlazado a un átomo. El enlace se guarda en el propio átomo:
+   solo la primera aparición tras la declaración pasa por sym_lookup.
+   (Válido mientras todo viva en el ámbito global de la symtab.) */
+static info_simbolo* resolver(atomo* nombre) {
+    if (!nombre->simbolo) {
+        sym_value_type info;
+        if (sym_lookup(nombre->nombre, &info) == SYMTAB_OK) nombre->simbolo = info;
+    }
+    return nombre->simbolo;
+}
+
+/* Operando de una variable (si no está declarada queda con tipo T_ERROR) */
+static operando operando_variable(atomo* nombre) {
+    info_simbolo* info = resolver(nombre);
+    return sem_opnd_var(nombre->nombre, info ? info->tipo : T_ERROR);
 }
 
-atributos sem_obtener_simbolo(char* nombre) {
-    sym_value_type info;
-    if (sym_lookup(nombre, &info) == SYMTAB_NOT_FOUND) {
+atributos sem_obtener_simbolo(atomo* nombre) {
+    info_simbolo* info = resolver(nombre);
+    if (!info) {
         char err[100];
-        sprintf(err, "Variable no declarada: %s", nombre);
-        yyerror(err);
-        return sem_crear_literal("err", T_ERROR);
+        snprintf(err, sizeof(err), "Variable no declarada: %s", nombre->nombre);
+        sem_error(err);
+        return crear_atribs(sem_opnd_var("err", T_ERROR));
     }
-    // Creamos copia ligera
-    info_simbolo* copia = malloc(sizeof(info_simbolo));
-    copia->nombre = info->nombre;
-    copia->tipo = info->tipo;
-    return crear_atribs(copia);
+    return crear_atribs(sem_opnd_var(info->nombre, info->tipo));
 }
 
-void sem_declarar(int tipo, char* nombre) {
-    info_simbolo* nodo = malloc(sizeof(info_simbolo));
+void sem_declarar(int tipo, atomo* nombre) {
+    info_simbolo* nodo = arena_reservar(sizeof(info_simbolo));
     nodo->tipo = tipo;
-    nodo->nombre = strdup(nombre);
+    nodo->nombre = (char*)nombre->nombre; // El átomo ya es una copia única
     nodo->u.valor_int = 0;
+    nodo->tamanyo = 0;
+    nodo->num_campos = 0;
     sym_value_type ptr = nodo;
-    
-    if (sym_add(nombre, &ptr) == SYMTAB_DUPLICATE) {
-        fprintf(stderr, "Error: Variable %s ya declarada\n", nombre);
+
+    if (sym_add(nodo->nombre, &ptr) == SYMTAB_DUPLICATE) {
+        char err[100];
+        snprintf(err, sizeof(err), "Variable %s ya declarada", nombre->nombre);
+        sem_error(err);
+    } else {
+        nombre->simbolo = nodo;
     }
 }
 
-void sem_declarar_array(int tipo, char* nombre, int tamanyo) {
+void sem_declarar_array(int tipo, atomo* nombre, int tamanyo) {
+    info_simbolo* previo = nombre->simbolo;
     sem_declarar(tipo, nombre);
+    /* Si ya estaba declarado se queda con el tamaño de la primera vez */
+    if (nombre->simbolo && nombre->simbolo != previo) nombre->simbolo->tamanyo = tamanyo;
+}
+
+/* --- PLEGADO DE CONSTANTES --- */
+
+static int es_literal(operando o) {
+    return o.clase == OPND_ENTERO || o.clase == OPND_REAL;
+}
+
+/* Potencia entera por cuadrados (con desbordamiento modular, como ADDI/MULI) */
+static int potencia_entera(int base, int exponente) {
+    unsigned r = 1, b = (unsigned)base;
+    while (exponente > 0) {
+        if (exponente & 1) r *= b;
+        b *= b;
+        exponente >>= 1;
+    }
+    return (int)r;
+}
+
+/* Calcula 'a op b' (o 'op a') en tiempo de compilación si los operandos son
+   literales del tipo de la instrucción. Devuelve 0 (y se emite el quad)
+   cuando el resultado depende de la ejecución: división o módulo por cero,
+   INT_MIN / -1, exponente entero negativo o un real que no es finito. */
+int sem_plegar(op_c3a op, operando a, operando b, operando* res) {
+    if (a.clase == OPND_ENTERO) {
+        if (op == OP_CHSI) {
+            *res = sem_opnd_entero((int)(0u - (unsigned)a.u.valor_int));
+            return 1;
+        }
+        if (op == OP_I2F) {
+            *res = sem_opnd_real((float)a.u.valor_int);
+            return 1;
+        }
+    }
+    if (a.clase == OPND_REAL && op == OP_CHSF) {
+        *res = sem_opnd_real(-a.u.valor_float);
+        return 1;
+    }
+    if (a.clase == OPND_ENTERO && b.clase == OPND_ENTERO) {
+        int x = a.u.valor_int, y = b.u.valor_int;
+        unsigned ux = (unsigned)x, uy = (unsigned)y;
+        switch (op) {
+            case OP_ADDI: *res = sem_opnd_entero((int)(ux + uy)); return 1;
+            case OP_SUBI: *res = sem_opnd_entero((int)(ux - uy)); return 1;
+            case OP_MULI: *res = sem_opnd_entero((int)(ux * uy)); return 1;
+            case OP_DIVI:
+            case OP_MODI:
+                if (y == 0 || (x == INT_MIN && y == -1)) return 0;
+                *res = sem_opnd_entero(op == OP_DIVI ? x / y : x % y);
+                return 1;
+            case OP_POW:
+                if (y < 0) return 0;
+                *res = sem_opnd_entero(potencia_entera(x, y));
+                return 1;
+            default:
+                return 0;
+        }
+    }
+    if (a.clase == OPND_REAL && b.clase == OPND_REAL) {
+        float x = a.u.valor_float, y = b.u.valor_float, r;
+        switch (op) {
+            case OP_ADDF: r = x + y; break;
+            case OP_SUBF: r = x - y; break;
+            case OP_MULF: r = x * y; break;
+            case OP_DIVF:
+                if (y == 0.0f) return 0;
+                r = x / y;
+                break;
+            case OP_POW:  r = powf(x, y); break;
+            default:
+                return 0;
+        }
+        if (!isfinite(r)) return 0;
+        *res = sem_opnd_real(r);
+        return 1;
+    }
+    return 0;
+}
+
+/* Evalúa 'a rel b' entre literales (comparando en real si alguno lo es) */
+int sem_comparar_literales(op_rel rel, operando a, operando b) {
+    int cmp;
+    if (a.clase == OPND_REAL || b.clase == OPND_REAL) {
+        float x = a.clase == OPND_REAL ? a.u.valor_float : (float)a.u.valor_int;
+        float y = b.clase == OPND_REAL ? b.u.valor_float : (float)b.u.valor_int;
+        cmp = (x > y) - (x < y);
+    } else {
+        cmp = (a.u.valor_int > b.u.valor_int) - (a.u.valor_int < b.u.valor_int);
+    }
+    switch (rel) {
+        case REL_EQ: return cmp == 0;
+        case REL_NE: return cmp != 0;
+        case REL_LT: return cmp < 0;
+        case REL_LE: return cmp <= 0;
+        case REL_GT: return cmp > 0;
+        case REL_GE: return cmp >= 0;
+    }
+    return 0;
 }
 
 /* --- OPERACIONES --- */
 
-atributos sem_operar_binario(atributos A, atributos B, char* op_int, char* op_float) {
-    char* temporal = sem_generar_temporal();
+atributos sem_operar_binario(atributos A, atributos B, op_c3a op_int, op_c3a op_float) {
     int tipo_result = T_ENTERO;
-    char* instruccion = op_int;
+    op_c3a instruccion = op_int;
 
-    // Casting implícito básico
-    if (A.simb->tipo == T_REAL || B.simb->tipo == T_REAL) {
+    if (A.dir.tipo == T_REAL || B.dir.tipo == T_REAL) {
         tipo_result = T_REAL;
         instruccion = op_float;
-        
-        if (A.simb->tipo == T_ENTERO) {
-            char* temp_cast = sem_generar_temporal();
-            sem_emitir("%s := I2F %s", temp_cast, A.simb->nombre);
-            A.simb->nombre = temp_cast;
+
+        /* I2F de un literal entero: ya es un literal real */
+        if (sem_opciones.plegar) {
+            if (A.dir.clase == OPND_ENTERO) A.dir = sem_opnd_real((float)A.dir.u.valor_int);
+            if (B.dir.clase == OPND_ENTERO) B.dir = sem_opnd_real((float)B.dir.u.valor_int);
         }
-        if (B.simb->tipo == T_ENTERO) {
-            char* temp_cast = sem_generar_temporal();
-            sem_emitir("%s := I2F %s", temp_cast, B.simb->nombre);
-            B.simb->nombre = temp_cast;
+    }
+
+    operando plegado;
+    if (sem_opciones.plegar && sem_plegar(instruccion, A.dir, B.dir, &plegado)) {
+        return crear_atribs(plegado);
+    }
+
+    operando temporal = sem_generar_temporal(tipo_result);
+
+    // Casting implícito básico
+    if (tipo_result == T_REAL) {
+        if (A.dir.tipo == T_ENTERO) {
+            operando temp_cast = sem_generar_temporal(T_REAL);
+            sem_emitir(OP_I2F, temp_cast, A.dir, sem_opnd_nulo());
+            A.dir = temp_cast;
+        }
+        if (B.dir.tipo == T_ENTERO) {
+            operando temp_cast = sem_generar_temporal(T_REAL);
+            sem_emitir(OP_I2F, temp_cast, B.dir, sem_opnd_nulo());
+            B.dir = temp_cast;
         }
     }
 
-    sem_emitir("%s := %s %s %s", temporal, A.simb->nombre, instruccion, B.simb->nombre);
-    return sem_crear_literal(temporal, tipo_result);
+    sem_emitir(instruccion, temporal, A.dir, B.dir);
+    return crear_atribs(temporal);
+}
+
+atributos sem_cambiar_signo(atributos A) {
+    /* Plegado: el opuesto de un literal es otro literal */
+    operando plegado;
+    if (sem_opciones.plegar &&
+        sem_plegar(A.dir.tipo == T_REAL ? OP_CHSF : OP_CHSI, A.dir, sem_opnd_nulo(), &plegado)) {
+        return crear_atribs(plegado);
+    }
+
+    operando temp = sem_generar_temporal(A.dir.tipo);
+    if (A.dir.tipo == T_REAL)
+        sem_emitir(OP_CHSF, temp, A.dir, sem_opnd_nulo());
+    else
+        sem_emitir(OP_CHSI, temp, A.dir, sem_opnd_nulo());
+    return crear_atribs(temp);
+}
+
+void sem_asignar_operando(operando destino, atributos valor) {
+    sem_emitir(OP_COPIA, destino, valor.dir, sem_opnd_nulo());
 }
 
-void sem_asignar(char* destino, atributos valor) {
-    sem_emitir("%s := %s", destino, valor.simb->nombre);
+void sem_asignar(atomo* destino, atributos valor) {
+    sem_asignar_operando(operando_variable(destino), valor);
 }
 
-void sem_asignar_array(char* nombre_array, atributos indice, atributos valor) {
-    char* t_offset = sem_generar_temporal();
-    sem_emitir("%s := %s MULI 4", t_offset, indice.simb->nombre);
-    sem_emitir("%s[%s] := %s", nombre_array, t_offset, valor.simb->nombre);
+void sem_asignar_array(atomo* nombre_array, atributos indice, atributos valor) {
+    operando t_offset = sem_generar_temporal(T_ENTERO);
+    sem_emitir(OP_MULI, t_offset, indice.dir, sem_opnd_entero(4));
+    /* El valor se guarda con el tipo del array, como en una asignación */
+    operando array = operando_variable(nombre_array);
+    operando convertido;
+    if (array.tipo == T_REAL && valor.dir.tipo == T_ENTERO) {
+        if (!(sem_opciones.plegar && sem_plegar(OP_I2F, valor.dir, sem_opnd_nulo(), &convertido))) {
+            convertido = sem_generar_temporal(T_REAL);
+            sem_emitir(OP_I2F, convertido, valor.dir, sem_opnd_nulo());
+        }
+        valor.dir = convertido;
+    } else if (array.tipo == T_ENTERO && valor.dir.tipo == T_REAL) {
+        convertido = sem_generar_temporal(T_ENTERO);
+        sem_emitir(OP_COPIA, convertido, valor.dir, sem_opnd_nulo());
+        valor.dir = convertido;
+    }
+    sem_emitir(OP_GUARDA_IDX, array, t_offset, valor.dir);
 }
 
-atributos sem_acceder_array(char* nombre_array, atributos indice) {
-    char* t_offset = sem_generar_temporal();
-    sem_emitir("%s := %s MULI 4", t_offset, indice.simb->nombre);
-    char* t_res = sem_generar_temporal();
-    sem_emitir("%s := %s[%s]", t_res, nombre_array, t_offset);
-    return sem_crear_literal(t_res, T_ENTERO);
+atributos sem_acceder_array(atomo* nombre_array, atributos indice) {
+    operando t_offset = sem_generar_temporal(T_ENTERO);
+    sem_emitir(OP_MULI, t_offset, indice.dir, sem_opnd_entero(4));
+    /* El elemento es del tipo del array (float v[10] da reales) */
+    operando array = operando_variable(nombre_array);
+    operando t_res = sem_generar_temporal(array.tipo == T_REAL ? T_REAL : T_ENTERO);
+    sem_emitir(OP_CARGA_IDX, t_res, array, t_offset);
+    return crear_atribs(t_res);
 }
 
 void sem_imprimir_expresion(atributos s) {
-    sem_emitir("PARAM %s", s.simb->nombre);
-    if (s.simb->tipo == T_REAL) sem_emitir("CALL PUTF, 1");
-    else sem_emitir("CALL PUTI, 1");
+    sem_emitir(OP_PARAM, sem_opnd_nulo(), s.dir, sem_opnd_nulo());
+    if (s.dir.tipo == T_REAL)
+        sem_emitir(OP_CALL, sem_opnd_nulo(), sem_opnd_var("PUTF", T_ERROR), sem_opnd_entero(1));
+    else
+        sem_emitir(OP_CALL, sem_opnd_nulo(), sem_opnd_var("PUTI", T_ERROR), sem_opnd_entero(1));
 }
 
 
 /* --- LÓGICA BOOLEANA --- */
 
-atributos sem_operar_relacional(atributos A, atributos B, char* op) {
-    /* 1. Comprobar tipos y castear si es necesario */
-    char* sufijo = "I"; // Por defecto Entero
-    if (A.simb->tipo == T_REAL || B.simb->tipo == T_REAL) {
-        sufijo = "F";   // Si alguno es real, usamos Float
+atributos sem_operar_relacional(atributos A, atributos B, op_rel op) {
+    atributos res;
+    res.dir = sem_opnd_nulo(); // Una exp booleana no tiene valor "$t", tiene flujo
+    res.nextlist = NULL;
+
+    /* 0. Plegado: con dos literales el resultado ya se conoce y basta con un
+          GOTO en la lista que toque (igual que 'true' / 'false') */
+    if (sem_opciones.plegar && es_literal(A.dir) && es_literal(B.dir)) {
+        int instr = sem_emitir_salto(0);
+        if (sem_comparar_literales(op, A.dir, B.dir)) {
+            res.truelist = sem_makelist(instr);
+            res.falselist = NULL;
+        } else {
+            res.truelist = NULL;
+            res.falselist = sem_makelist(instr);
+        }
+        return res;
     }
 
-    /* 2. Construir el operador completo (ej: "LTI" o "LTF") */
-    char op_completo[10];
-    sprintf(op_completo, "%s%s", op, sufijo);
+    /* 1. Comprobar tipos: si alguno es real comparamos en Float (ej: "LTF") */
+    op_c3a op_si = OP_IFI; // Por defecto Entero
+    if (A.dir.tipo == T_REAL || B.dir.tipo == T_REAL) {
+        op_si = OP_IFF;
+    }
 
-    /* 3. Generar el salto condicional VERDADERO incompleto */
+    /* 2. Generar el salto condicional VERDADERO incompleto */
     /* "IF a LT b GOTO [hueco]" */
-    int instr_true = sem_emitir("IF %s %s %s GOTO", A.simb->nombre, op_completo, B.simb->nombre);
-    
-    /* 4. Generar el salto FALSO incompleto (un GOTO incondicional justo después) */
+    int instr_true = sem_emitir_si(op_si, op, A.dir, B.dir, 0);
+
+    /* 3. Generar el salto FALSO incompleto (un GOTO incondicional justo después) */
     /* Si no saltó en el IF, caerá aquí. "GOTO [hueco]" */
-    int instr_false = sem_emitir("GOTO");
+    int instr_false = sem_emitir_salto(0);
+
+    /* 4. Crear las listas de backpatching */
 
-    /* 5. Crear las listas de backpatching */
-    atributos res;
-    res.simb = NULL; // Una exp booleana no tiene valor "$t", tiene flujo
-    
     /* La truelist contiene la instrucción del IF (que saltará si es verdad) */
     res.truelist = sem_makelist(instr_true);
-    
+
     /* La falselist contiene la instrucción del GOTO (que saltará si es mentira) */
     res.falselist = sem_makelist(instr_false);
-    
-    res.nextlist = NULL;
+
     return res;
 }
 
 /* --- GESTIÓN DE SWITCH --- */
 
-void sem_push_switch(char* nombre_var) {
-    if (switch_top < 10) {
-        switch_stack[switch_top++] = strdup(nombre_var);
+void sem_push_switch(atributos var) {
+    if (switch_top == cap_switch) {
+        cap_switch = cap_switch ? cap_switch * 2 : 8;
+        switch_stack = realloc(switch_stack, sizeof(info_switch) * cap_switch);
+        if (!switch_stack) {
+            fprintf(stderr, "Error fatal: Sin memoria para la pila de switch\n");
+            exit(1);
+        }
     }
+    info_switch* s = &switch_stack[switch_top++];
+    s->var = var;
+    s->inicio = sig_instruccion;
+    sem_abrir_region(s->inicio);   /* Los cuerpos se sacan del buffer al cerrar */
+    s->etiqueta_default = 0;
+    s->casos = NULL;
+    s->num_casos = s->cap_casos = 0;
 }
 
 void sem_pop_switch() {
     if (switch_top > 0) {
         switch_top--;
+        free(switch_stack[switch_top].casos);
+    }
+}
+
+void sem_anyadir_caso(int valor) {
+    if (switch_top == 0) return;
+    info_switch* s = &switch_stack[switch_top - 1];
+    if (s->num_casos == s->cap_casos) {
+        s->cap_casos = s->cap_casos ? s->cap_casos * 2 : 16;
+        s->casos = realloc(s->casos, sizeof(caso_switch) * s->cap_casos);
+        if (!s->casos) {
+            fprintf(stderr, "Error fatal: Sin memoria para los casos del switch\n");
+            exit(1);
+        }
     }
+    s->casos[s->num_casos].valor = valor;
+    s->casos[s->num_casos].etiqueta = sig_instruccion;
+    s->num_casos++;
 }
 
-char* sem_get_switch_var() {
-    if (switch_top > 0) return switch_stack[switch_top - 1];
-    return "err";
+void sem_anyadir_default() {
+    if (switch_top > 0) switch_stack[switch_top - 1].etiqueta_default = sig_instruccion;
 }
 
 /* --- PILA DE LISTAS DE BREAK --- */
 
 void sem_init_break_layer() {
     /* Iniciamos una nueva capa (nuevo bucle) */
-    if (break_list_top < 20) {
-        break_list_stack[break_list_top++] = NULL; // Lista vacía
+    if (break_list_top == cap_break) {
+        cap_break = cap_break ? cap_break * 2 : 16;
+        break_list_stack = realloc(break_list_stack, sizeof(lista_nodos*) * cap_break);
+        if (!break_list_stack) {
+            fprintf(stderr, "Error fatal: Sin memoria para la pila de break\n");
+            exit(1);
+        }
     }
+    break_list_stack[break_list_top++] = NULL; // Lista vacía
 }
 
 void sem_close_break_layer(int etiqueta_destino) {
@@ -307,36 +911,426 @@ void sem_close_break_layer(int etiqueta_destino) {
     }
 }
 
+static void anyadir_break(int salto) {
+    // Añadir a la lista del tope de la pila
+    break_list_stack[break_list_top - 1] = sem_merge(break_list_stack[break_list_top - 1], sem_makelist(salto));
+}
+
 void sem_add_break() {
     /* Añadimos un salto pendiente a la capa actual */
     if (break_list_top > 0) {
-        int salto = sem_emitir("GOTO"); // Salto hueco
-        // Añadir a la lista del tope de la pila
-        break_list_stack[break_list_top - 1] = sem_merge(break_list_stack[break_list_top - 1], sem_makelist(salto));
+        anyadir_break(sem_emitir_salto(0)); // Salto hueco
     }
 }
 
 /* --- LOOP UNROLLING --- */
 
-void sem_start_record() {
-    recording = 1;
-    code_buffer[0] = '\0'; // Limpiar buffer
+/* El cuerpo de un bucle se emite como cualquier otro código, con sus
+   saltos ya rellenados. Al cerrar el bucle, si conviene desenrollarlo, se
+   copia esa región, se quita del buffer y se vuelve a emitir tantas veces
+   como haga falta recolocando los saltos internos de cada copia. */
+
+static int es_salto(op_c3a op) {
+    return op == OP_IFI || op == OP_IFF || op == OP_GOTO;
+}
+
+/* Quita del buffer los quads desde 'inicio' y olvida los break de la capa
+   actual que apuntaban a ellos (las copias los volverán a añadir) */
+static void descartar_desde(int inicio) {
+    sig_instruccion = inicio;
+    if (break_list_top == 0) return;
+
+    lista_nodos* p = break_list_stack[break_list_top - 1];
+    lista_nodos* quedan = NULL;
+    while (p) {
+        lista_nodos* siguiente = p->siguiente;
+        p->siguiente = NULL;
+        p->cola = p;
+        if (p->referencia < inicio) quedan = sem_merge(quedan, p);
+        else sem_liberar_lista(p);
+        p = siguiente;
+    }
+    break_list_stack[break_list_top - 1] = quedan;
+}
+
+int sem_start_record() {
+    sem_abrir_region(sig_instruccion);
+    return sig_instruccion;
+}
+
+bloque_quads sem_stop_record(int inicio) {
+    bloque_quads b;
+    b.origen = inicio;
+    b.num = sig_instruccion - inicio;
+    b.quads = malloc(sizeof(quad) * (b.num > 0 ? b.num : 1)); // Copia de la región
+    if (!b.quads) {
+        fprintf(stderr, "Error fatal: Sin memoria para desenrollar el bucle\n");
+        exit(1);
+    }
+    for (int i = 0; i < b.num; i++) b.quads[i] = *quad_en(inicio + i);
+    descartar_desde(inicio);
+    cerrar_region();    /* La de sem_start_record o sem_push_switch */
+    return b;
+}
+
+/* Emite una copia del bloque. Los saltos dentro de la región original
+   (incluido el que va justo detrás) se desplazan a la copia; los que están
+   pendientes (destino 0) son break del bucle y van a la capa actual. */
+void sem_emitir_bloque(bloque_quads bloque) {
+    int desplazamiento = sig_instruccion - bloque.origen;
+    for (int i = 0; i < bloque.num; i++) {
+        quad q = bloque.quads[i];
+        if (es_salto(q.op) && q.destino >= bloque.origen && q.destino <= bloque.origen + bloque.num) {
+            q.destino += desplazamiento;
+        }
+        int instr = emitir_quad(q);
+        if (es_salto(q.op) && q.destino == 0 && break_list_top > 0) anyadir_break(instr);
+    }
+}
+
+void sem_liberar_bloque(bloque_quads bloque) {
+    free(bloque.quads);
+}
+
+static int quad_asigna(const quad* q, operando var) {
+    return q->op != OP_GUARDA_IDX && q->res.clase == OPND_VAR && q->res.u.nombre == var.u.nombre;
+}
+
+/* ¿Algún quad desde 'inicio' asigna la variable 'var'? */
+static int region_asigna(int inicio, operando var) {
+    if (var.clase != OPND_VAR) return 0;
+    for (int i = inicio; i < sig_instruccion; i++) {
+        if (quad_asigna(quad_en(i), var)) return 1;
+    }
+    return 0;
+}
+
+/* Lo mismo para un cuerpo ya sacado del buffer */
+static int bloque_asigna(bloque_quads bloque, operando var) {
+    if (var.clase != OPND_VAR) return 0;
+    for (int i = 0; i < bloque.num; i++) {
+        if (quad_asigna(&bloque.quads[i], var)) return 1;
+    }
+    return 0;
+}
+
+/* Umbrales: desenrollado completo de 'veces' copias de 'num' quads */
+static int cabe_total(long long veces, int num) {
+    return sem_opciones.desenrollar && veces <= sem_opciones.max_iteraciones &&
+           (veces <= 0 || veces * num <= sem_opciones.max_quads);
+}
+
+/* Factor del desenrollado parcial (0 si no se aplica) */
+static int factor_parcial(int num) {
+    int k = sem_opciones.factor;
+    if (!sem_opciones.desenrollar_parcial || k < 2 || (long long)k * num > sem_opciones.max_quads) return 0;
+    return k;
 }
 
-char* sem_stop_record() {
-    recording = 0;
-    return strdup(code_buffer); // Devolver copia del buffer
+/* var := var + 1 */
+static void incrementar(operando var) {
+    atributos suma = sem_operar_binario(crear_atribs(var), sem_crear_entero(1), OP_ADDI, OP_ADDF);
+    sem_asignar_operando(var, suma);
 }
 
-/* Función auxiliar para imprimir un bloque de texto línea a línea */
-void sem_emitir_bloque(char* bloque) {
-    if (!bloque) return;
-    char* copia = strdup(bloque); // Copia para no romper el original con strtok
-    char* linea = strtok(copia, "\n");
-    while (linea != NULL) {
-        /* Usamos sem_emitir para que ponga el número de línea correcto */
-        sem_emitir("%s", linea);
-        linea = strtok(NULL, "\n");
+/* Bucle de repeat: mientras contador < limite, 'copias' copias del cuerpo
+   y contador := contador + paso. Devuelve los saltos de salida. */
+static lista_nodos* bucle_contador(operando contador, atributos limite, bloque_quads cuerpo,
+                                   int copias, int paso) {
+    atributos at_contador = crear_atribs(contador);
+    int etiqueta_inicio = sig_instruccion;
+    atributos cond = sem_operar_relacional(at_contador, limite, REL_LT);
+    sem_backpatch(cond.truelist, sig_instruccion);
+    for (int k = 0; k < copias; k++) sem_emitir_bloque(cuerpo);
+    atributos suma = sem_operar_binario(at_contador, sem_crear_entero(paso), OP_ADDI, OP_ADDF);
+    sem_asignar_operando(contador, suma);
+    sem_emitir_salto(etiqueta_inicio);
+    return cond.falselist;
+}
+
+/* Bucle de for: mientras iter <= limite, 'copias' veces (cuerpo; iter++) */
+static lista_nodos* bucle_for(operando iter, atributos limite, bloque_quads cuerpo, int copias) {
+    int etiqueta_inicio = sig_instruccion;
+    atributos cond = sem_operar_relacional(crear_atribs(iter), limite, REL_LE);
+    sem_backpatch(cond.truelist, sig_instruccion);
+    for (int k = 0; k < copias; k++) {
+        sem_emitir_bloque(cuerpo);
+        incrementar(iter);
+    }
+    sem_emitir_salto(etiqueta_inicio);
+    return cond.falselist;
+}
+
+int sem_generar_repeat(bloque_quads cuerpo, atributos veces) {
+    int literal = veces.dir.clase == OPND_ENTERO;
+    int n = literal ? veces.dir.u.valor_int : 0;
+    int k;
+
+    /* CAMINO A: desenrollado completo (literal pequeño) */
+    if (literal && cabe_total(n, cuerpo.num)) {
+        for (int i = 0; i < n; i++) sem_emitir_bloque(cuerpo);
+        return sig_instruccion;
+    }
+
+    /* Contador temporal a 0 */
+    operando contador = sem_generar_temporal(T_ENTERO);
+    sem_asignar_operando(contador, sem_crear_entero(0));
+    lista_nodos* salida;
+
+    if ((k = factor_parcial(cuerpo.num)) && literal) {
+        /* CAMINO B: n / k vueltas de k copias y el resto seguido */
+        salida = bucle_contador(contador, sem_crear_entero(n / k), cuerpo, k, 1);
+        sem_backpatch(salida, sig_instruccion);
+        for (int i = 0; i < n % k; i++) sem_emitir_bloque(cuerpo);
+        return sig_instruccion;
+    }
+
+    if (k && veces.dir.tipo == T_ENTERO && !bloque_asigna(cuerpo, veces.dir)) {
+        /* CAMINO C: vueltas de k copias mientras queden k iteraciones
+           (contador < n - (k-1)) y un bucle normal para el resto.
+           Si n < k la resta podría desbordar: se va directo al resto. */
+        atributos corto = sem_operar_relacional(veces, sem_crear_entero(k), REL_LT);
+        sem_backpatch(corto.falselist, sig_instruccion);
+        operando limite = sem_generar_temporal(T_ENTERO);
+        sem_emitir(OP_SUBI, limite, veces.dir, sem_opnd_entero(k - 1));
+        salida = bucle_contador(contador, crear_atribs(limite), cuerpo, k, k);
+        sem_backpatch(sem_merge(salida, corto.truelist), sig_instruccion);
+    }
+
+    /* CAMINO D: bucle estándar (o el resto del camino C) */
+    salida = bucle_contador(contador, veces, cuerpo, 1, 1);
+    int etiqueta_salida = sig_instruccion;
+    sem_backpatch(salida, etiqueta_salida);
+    return etiqueta_salida;
+}
+
+int sem_generar_for(cabecera_for cab, int inicio_cuerpo) {
+    int num = sig_instruccion - inicio_cuerpo;
+    int entero = cab.iterador.tipo == T_ENTERO && cab.fin.tipo == T_ENTERO;
+    int fijo = entero && !region_asigna(inicio_cuerpo, cab.iterador) &&
+               !region_asigna(inicio_cuerpo, cab.fin);
+    lista_nodos* salida = cab.salida;
+    int k = 0;
+
+    if (fijo && cab.inicio.clase == OPND_ENTERO && cab.fin.clase == OPND_ENTERO) {
+        long long veces = (long long)cab.fin.u.valor_int - cab.inicio.u.valor_int + 1;
+        if (veces < 0) veces = 0;
+        if (cabe_total(veces, num + 2)) {
+            /* Desenrollado completo: fuera la comprobación y (cuerpo; iter++) x veces */
+            bloque_quads cuerpo = sem_stop_record(inicio_cuerpo);
+            descartar_desde(cab.etiqueta_inicio);
+            sem_liberar_lista(salida);
+            for (long long i = 0; i < veces; i++) {
+                sem_emitir_bloque(cuerpo);
+                incrementar(cab.iterador);
+            }
+            sem_liberar_bloque(cuerpo);
+            cerrar_region();    /* La de la cabecera */
+            return sig_instruccion;
+        }
+    }
+
+    if (fijo && (k = factor_parcial(num + 2))) {
+        /* Desenrollado parcial: vueltas de k copias mientras iter <= fin - (k-1)
+           y un bucle para el resto. Se rehace la cabecera. */
+        bloque_quads cuerpo = sem_stop_record(inicio_cuerpo);
+        descartar_desde(cab.etiqueta_inicio);
+        sem_liberar_lista(salida);
+
+        lista_nodos* al_resto = NULL;
+        atributos limite;
+        int hay_principal = 1;
+        if (cab.fin.clase == OPND_ENTERO) {
+            long long l = (long long)cab.fin.u.valor_int - (k - 1);
+            hay_principal = l >= INT_MIN;
+            limite = sem_crear_entero((int)l);
+        } else {
+            /* fin < INT_MIN + (k-1): la resta desbordaría, directo al resto */
+            atributos corto = sem_operar_relacional(crear_atribs(cab.fin), sem_crear_entero(INT_MIN + (k - 1)), REL_LT);
+            sem_backpatch(corto.falselist, sig_instruccion);
+            al_resto = corto.truelist;
+            limite = sem_crear_temporal(T_ENTERO);
+            sem_emitir(OP_SUBI, limite.dir, cab.fin, sem_opnd_entero(k - 1));
+        }
+        if (hay_principal) al_resto = sem_merge(al_resto, bucle_for(cab.iterador, limite, cuerpo, k));
+        sem_backpatch(al_resto, sig_instruccion);
+        salida = bucle_for(cab.iterador, crear_atribs(cab.fin), cuerpo, 1);
+        sem_liberar_bloque(cuerpo);
+    } else {
+        /* Bucle estándar: iter := iter + 1 y volver a la comprobación */
+        incrementar(cab.iterador);
+        sem_emitir_salto(cab.etiqueta_inicio);
+        cerrar_region();    /* La del cuerpo (sin sem_stop_record) */
+    }
+
+    cerrar_region();        /* La de la cabecera */
+    int etiqueta_salida = sig_instruccion;
+    sem_backpatch(salida, etiqueta_salida);
+    return etiqueta_salida;
+}
+
+/* --- DESPACHO DEL SWITCH --- */
+
+/* Los cuerpos de los casos se emiten según se leen, cada uno acabado en un
+   break. Al cerrar el switch se sacan del buffer, se emite el código que
+   elige el caso con todas las etiquetas ya conocidas y se vuelven a emitir
+   detrás. Ordenadas las etiquetas, un tramo denso se resuelve con una tabla
+   de saltos y uno disperso con una búsqueda binaria: el coste ya no crece
+   con la posición del caso. */
+
+#define MIN_CASOS_TABLA 4       /* Casos mínimos para una tabla de saltos */
+#define DENSIDAD_TABLA 2        /* Entradas de la tabla por caso como mucho */
+#define MAX_CASOS_LINEAL 3      /* Hasta aquí se compara uno a uno */
+
+/* Saltos del despacho: se rellenan al saber dónde quedan los cuerpos */
+typedef struct {
+    int salto;
+    int etiqueta;           /* En la posición original (0 = salida) */
+} salto_caso;
+
+static _Thread_local salto_caso* saltos_caso = NULL;
+static _Thread_local int num_saltos_caso = 0;
+static _Thread_local int cap_saltos_caso = 0;
+
+static void saltar_a_caso(int salto, int etiqueta) {
+    if (num_saltos_caso == cap_saltos_caso) {
+        cap_saltos_caso = cap_saltos_caso ? cap_saltos_caso * 2 : 64;
+        saltos_caso = realloc(saltos_caso, sizeof(salto_caso) * cap_saltos_caso);
+        if (!saltos_caso) {
+            fprintf(stderr, "Error fatal: Sin memoria para los casos del switch\n");
+            exit(1);
+        }
     }
-    free(copia);
-}
\ No newline at end of file
+    saltos_caso[num_saltos_caso].salto = salto;
+    saltos_caso[num_saltos_caso].etiqueta = etiqueta;
+    num_saltos_caso++;
+}
+
+static int comparar_casos(const void* x, const void* y) {
+    const caso_switch* a = x;
+    const caso_switch* b = y;
+    if (a->valor != b->valor) return a->valor < b->valor ? -1 : 1;
+    return (a->etiqueta > b->etiqueta) - (a->etiqueta < b->etiqueta);
+}
+
+static operando valor_caso(const info_switch* s, int valor) {
+    return s->var.dir.tipo == T_REAL ? sem_opnd_real((float)valor) : sem_opnd_entero(valor);
+}
+
+/* Ordena los casos y quita los repetidos: gana el primero del fuente, como
+   cuando se comparaban en orden (con un switch real cuentan como repetidos
+   dos enteros que dan el mismo float). Devuelve cuántos quedan. */
+static int ordenar_casos(info_switch* s) {
+    caso_switch* c = s->casos;
+    if (s->num_casos == 0) return 0;
+    qsort(c, s->num_casos, sizeof(caso_switch), comparar_casos);
+    int real = s->var.dir.tipo == T_REAL;
+    int quedan = 1;
+    for (int i = 1; i < s->num_casos; i++) {
+        caso_switch* ultimo = &c[quedan - 1];
+        int repetido = real ? (float)c[i].valor == (float)ultimo->valor : c[i].valor == ultimo->valor;
+        if (!repetido) c[quedan++] = c[i];
+        else if (c[i].etiqueta < ultimo->etiqueta) ultimo->etiqueta = c[i].etiqueta;
+    }
+    return quedan;
+}
+
+/* IF var < min / var > max GOTO default; GOTO TABLA[var - min] y una
+   entrada por valor del rango (los huecos van al default) */
+static void emitir_tabla(const info_switch* s, const caso_switch* c, int n) {
+    operando var = s->var.dir;
+    int min = c[0].valor, max = c[n - 1].valor;
+    saltar_a_caso(sem_emitir_si(OP_IFI, REL_LT, var, sem_opnd_entero(min), 0), s->etiqueta_default);
+    saltar_a_caso(sem_emitir_si(OP_IFI, REL_GT, var, sem_opnd_entero(max), 0), s->etiqueta_default);
+
+    operando indice = var;
+    if (min != 0 && !(sem_opciones.plegar && sem_plegar(OP_SUBI, var, sem_opnd_entero(min), &indice))) {
+        indice = sem_generar_temporal(T_ENTERO);
+        sem_emitir(OP_SUBI, indice, var, sem_opnd_entero(min));
+    }
+    sem_emitir(OP_GOTO_TABLA, sem_opnd_nulo(), indice, sem_opnd_entero(max - min + 1));
+
+    int k = 0;
+    for (long long v = min; v <= max; v++) {
+        int etiqueta = s->etiqueta_default;
+        if (c[k].valor == v) etiqueta = c[k++].etiqueta;
+        saltar_a_caso(sem_emitir_salto(0), etiqueta);
+    }
+}
+
+/* Elige entre los casos c[0..n-1] (ordenados) o salta al default */
+static void despachar(const info_switch* s, const caso_switch* c, int n) {
+    operando var = s->var.dir;
+    op_c3a op_si = var.tipo == T_REAL ? OP_IFF : OP_IFI;
+
+    if (n >= MIN_CASOS_TABLA && var.tipo != T_REAL &&
+        (long long)c[n - 1].valor - c[0].valor + 1 <= (long long)DENSIDAD_TABLA * n) {
+        emitir_tabla(s, c, n);
+        return;
+    }
+    if (n <= MAX_CASOS_LINEAL) {
+        for (int k = 0; k < n; k++) {
+            saltar_a_caso(sem_emitir_si(op_si, REL_EQ, var, valor_caso(s, c[k].valor), 0), c[k].etiqueta);
+        }
+        saltar_a_caso(sem_emitir_salto(0), s->etiqueta_default);
+        return;
+    }
+
+    /* Búsqueda binaria: var >= c[m] a la mitad de arriba */
+    int m = n / 2;
+    int salto = sem_emitir_si(op_si, REL_GE, var, valor_caso(s, c[m].valor), 0);
+    despachar(s, c, m);
+    quad_en(salto)->destino = sig_instruccion;
+    despachar(s, c + m, n - m);
+}
+
+int sem_generar_switch() {
+    if (switch_top == 0) return sig_instruccion;
+    info_switch* s = &switch_stack[switch_top - 1];
+
+    bloque_quads cuerpos = sem_stop_record(s->inicio);
+    num_saltos_caso = 0;
+    despachar(s, s->casos, ordenar_casos(s));
+
+    /* Los cuerpos van justo detrás del despacho; sin default se sale */
+    int desplazamiento = sig_instruccion - cuerpos.origen;
+    for (int i = 0; i < num_saltos_caso; i++) {
+        salto_caso* sc = &saltos_caso[i];
+        if (sc->etiqueta != 0) quad_en(sc->salto)->destino = sc->etiqueta + desplazamiento;
+        else if (break_list_top > 0) anyadir_break(sc->salto);
+    }
+    sem_emitir_bloque(cuerpos);
+    sem_liberar_bloque(cuerpos);
+
+    free(saltos_caso);
+    saltos_caso = NULL;
+    num_saltos_caso = cap_saltos_caso = 0;
+    return sig_instruccion;
+}
+
+/* --- REINICIO --- */
+
+void sem_reiniciar() {
+    sem_liberar_codigo();
+    while (switch_top > 0) sem_pop_switch();
+    free(switch_stack);
+    switch_stack = NULL;
+    cap_switch = 0;
+    break_list_top = 0;
+    free(break_list_stack);
+    break_list_stack = NULL;
+    cap_break = 0;
+    while (bloques_nodos) {
+        bloque_nodos* b = bloques_nodos;
+        bloques_nodos = b->anterior;
+        free(b);
+    }
+    nodos_libres = NULL;
+    free(saltos_caso);
+    saltos_caso = NULL;
+    num_saltos_caso = cap_saltos_caso = 0;
+    salida_continua = NULL;
+    sig_instruccion = 1;
+    contador_temporales = 1;
+    linea_token = 1;
+}
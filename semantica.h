@@ -1,84 +1,249 @@
 #ifndef SEMANTICA_H
 #define SEMANTICA_H
 
+#include <stdio.h>
 #include "symtab.h"
+#include "atomos.h"
+
+// --- REPRESENTACIÓN INTERMEDIA (QUADS) ---
+
+// Códigos de operación del C3A
+typedef enum {
+    OP_COPIA,                   // res := arg1
+    OP_ADDI, OP_ADDF,           // res := arg1 OP arg2
+    OP_SUBI, OP_SUBF,
+    OP_MULI, OP_MULF,
+    OP_DIVI, OP_DIVF,
+    OP_MODI,
+    OP_POW,
+    OP_CHSI, OP_CHSF,           // res := OP arg1
+    OP_I2F,
+    OP_CARGA_IDX,               // res := arg1[arg2]
+    OP_GUARDA_IDX,              // res[arg1] := arg2
+    OP_IFI, OP_IFF,             // IF arg1 rel arg2 GOTO destino
+    OP_GOTO,                    // GOTO destino
+    OP_GOTO_TABLA,              // Salta a la entrada arg1 (0..arg2-1) de la tabla:
+                                // los arg2 GOTO que le siguen
+    OP_PARAM,                   // PARAM arg1
+    OP_CALL,                    // CALL arg1, arg2
+    OP_HALT
+} op_c3a;
+
+// Operadores relacionales de los saltos condicionales
+typedef enum { REL_EQ, REL_NE, REL_LT, REL_LE, REL_GT, REL_GE } op_rel;
+
+// Clase de cada hueco de operando de un quad
+typedef enum {
+    OPND_NULO,      // Hueco no usado
+    OPND_VAR,       // Variable de usuario (o nombre de rutina en CALL)
+    OPND_TEMP,      // Temporal $tNN
+    OPND_ENTERO,    // Literal entero
+    OPND_REAL       // Literal real
+} clase_operando;
+
+typedef struct {
+    clase_operando clase;
+    tipo_variable tipo;     // Tipo del valor (T_ENTERO, T_REAL...)
+    union {
+        const char *nombre; // OPND_VAR: apunta al nombre guardado en la symtab
+        int temp;           // OPND_TEMP: número del temporal
+        int valor_int;      // OPND_ENTERO
+        float valor_float;  // OPND_REAL
+    } u;
+} operando;
+
+// Instrucción de tres direcciones
+typedef struct {
+    op_c3a op;
+    op_rel rel;         // Solo para OP_IFI / OP_IFF
+    operando res;
+    operando arg1;
+    operando arg2;
+    int destino;        // Salto de OP_IFx / OP_GOTO (0 = pendiente de backpatch)
+    int linea;          // Línea del fuente que lo generó (0 = añadido por una pasada)
+} quad;
+
+// Copia de un trozo de código grabado (loop unrolling)
+typedef struct {
+    quad *quads;
+    int num;
+    int origen;         // Número del primer quad en la posición original
+} bloque_quads;
 
 // --- ESTRUCTURAS PARA BACKPATCHING ---
 
-// Nodo de una lista de etiquetas pendientes de rellenar
+// Nodo de una lista de etiquetas pendientes de rellenar.
+// Una lista es un puntero a su primer nodo; la cabeza guarda además
+// el último nodo para poder fusionar en O(1).
 typedef struct lista_nodos {
     int referencia; // Número de instrucción que tiene el hueco a rellenar
     struct lista_nodos *siguiente;
+    struct lista_nodos *cola; // Último nodo (solo válido en la cabeza)
 } lista_nodos;
 
-// Estructura que devuelven las expresiones booleanas y sentencias
+// Estructura que devuelven las expresiones booleanas y sentencias.
+// Es un manejador ligero: no apunta a ningún info_simbolo.
 typedef struct {
-    info_simbolo *simb;      // Para expresiones aritméticas (el resultado $t1)
+    operando dir;            // Dónde está el valor (variable, $t1 o literal) y su tipo
     lista_nodos *truelist;   // Lista de saltos si es VERDADERO
     lista_nodos *falselist;  // Lista de saltos si es FALSO
     lista_nodos *nextlist;   // Lista de saltos al terminar el bloque
     int quad;                // Número de instrucción (para marcadores M)
 } atributos;
 
+// Cabecera ya emitida de un for: "iter := inicio" y "L: IF iter > fin GOTO salida"
+typedef struct {
+    operando iterador;
+    operando inicio;
+    operando fin;
+    int etiqueta_inicio;     // L: la comprobación
+    lista_nodos *salida;     // Salto de salida pendiente
+} cabecera_for;
+
+// --- OPCIONES DE GENERACIÓN ---
+
+// Optimizaciones que se aplican mientras se emite (las activa o desactiva
+// el gestor de pasadas de optimizador.c antes del parse, en cada hilo con
+// las de su compilación)
+typedef struct {
+    int plegar;             // Plegado de constantes en las expresiones
+    int desenrollar;        // Desenrollado completo de repeat/for con límites literales
+    int desenrollar_parcial;// Desenrollado por un factor con bucle de resto
+    int max_iteraciones;    // Máximo de copias en el desenrollado completo
+    int max_quads;          // Máximo de quads que puede ocupar el cuerpo desenrollado
+    int factor;             // Copias por vuelta del desenrollado parcial
+} opciones_sem;
+
+extern _Thread_local opciones_sem sem_opciones;
+
 // --- FUNCIONES DE BUFFER Y EMISIÓN ---
 
-// Emite una instrucción al buffer y devuelve su número de línea
-int sem_emitir(const char* fmt, ...);
+// Constructores de operandos
+operando sem_opnd_nulo();
+operando sem_opnd_var(const char* nombre, int tipo);
+operando sem_opnd_temp(int numero, int tipo);
+operando sem_opnd_entero(int valor);
+operando sem_opnd_real(float valor);
+
+// Emite un quad al buffer y devuelve su número de línea
+int sem_emitir(op_c3a op, operando res, operando arg1, operando arg2);
+
+// Emite "IF a rel b GOTO destino" (destino 0 = hueco para backpatch)
+int sem_emitir_si(op_c3a op, op_rel rel, operando a, operando b, int destino);
+
+// Emite "GOTO destino" (destino 0 = hueco para backpatch)
+int sem_emitir_salto(int destino);
 
-// Imprime todo el buffer al fichero de salida (al final del main)
+// Imprime el buffer (lo que queda sin volcar) al fichero de salida y lo libera
 void sem_finalizar_salida(FILE* out);
 
+// Libera el buffer sin imprimirlo (cuando el programa se ejecuta con --run)
+void sem_liberar_codigo();
+
+// El estado de la generación es de cada hilo. sem_reiniciar lo libera todo
+// (buffer, pilas, pool de nodos) y lo deja listo para otro programa.
+void sem_reiniciar();
+
+// Línea donde empieza el último token leído: cada quad guarda la de la
+// sentencia que lo genera (la pone yylex en calculadora.y)
+extern _Thread_local int linea_token;
+
+// Salida continua (--stream): al acabar cada sentencia, si se ha llenado
+// algún trozo, sem_volcar_terminados imprime en 'out' los quads que ya no
+// pueden cambiar (por debajo del primer salto pendiente o región abierta)
+// y libera sus trozos. Solo sirve sin pasadas sobre el programa completo;
+// sem_finalizar_salida imprime el resto.
+void sem_salida_continua(FILE* out);
+void sem_volcar_terminados();
+
+// Región que se puede volver a escribir desde 'inicio' (la cabecera de un
+// for): no se vuelca con --stream hasta que se cierra el bucle
+void sem_abrir_region(int inicio);
+
+// Escribe el texto C3A del quad i, sin número ni salto de línea
+void sem_imprimir_quad(FILE* out, int i);
+
+// Acceso al buffer para las pasadas de optimización (quads 1..sem_num_quads())
+int sem_num_quads();
+quad* sem_quad(int i);
+void sem_truncar(int num);      // Deja solo los quads 1..num
+int sem_emitir_quad(quad q);    // Añade un quad ya construido al final
+int sem_num_temporales();       // Temporales generados ($t01..)
+
 // --- FUNCIONES DE LISTAS (BACKPATCHING) ---
 
 // Crea una lista nueva con una sola referencia (número de instrucción)
 lista_nodos* sem_makelist(int referencia);
 
-// Fusiona dos listas en una sola
+// Fusiona dos listas en una sola (O(1), l2 deja de ser una lista aparte)
 lista_nodos* sem_merge(lista_nodos* l1, lista_nodos* l2);
 
-// Rellena las direcciones de los saltos de la lista con la etiqueta destino
+// Rellena las direcciones de los saltos de la lista con la etiqueta destino.
+// La lista queda consumida: sus nodos vuelven al pool.
 void sem_backpatch(lista_nodos* lista, int etiqueta_destino);
 
 
 // --- GESTIÓN DE VARIABLES Y OPERACIONES ---
 
-char* sem_generar_temporal();
+operando sem_generar_temporal(int tipo);
 atributos sem_crear_temporal(int tipo);
 int sem_generar_etiqueta(); // Devuelve la siguiente instrucción libre
 
+// Plegado de constantes: calcula 'a op b' si se puede en compilación (1 = sí)
+int sem_plegar(op_c3a op, operando a, operando b, operando* res);
+// Resultado de 'a rel b' entre dos literales (se compara en real si alguno lo es)
+int sem_comparar_literales(op_rel rel, operando a, operando b);
+
 // Operaciones aritméticas (devuelve atributos completos)
-atributos sem_operar_binario(atributos A, atributos B, char* op_int, char* op_float);
-atributos sem_crear_literal(char* valor, int tipo);
-atributos sem_obtener_simbolo(char* nombre);
-atributos sem_acceder_array(char* nombre_array, atributos indice);
+atributos sem_operar_binario(atributos A, atributos B, op_c3a op_int, op_c3a op_float);
+atributos sem_cambiar_signo(atributos A);
+atributos sem_crear_entero(int valor);
+atributos sem_crear_real(float valor);
+atributos sem_obtener_simbolo(atomo* nombre);
+atributos sem_acceder_array(atomo* nombre_array, atributos indice);
 
 // Sentencias
-void sem_asignar(char* nombre_destino, atributos valor);
-void sem_asignar_array(char* nombre_array, atributos indice, atributos valor);
+void sem_asignar(atomo* nombre_destino, atributos valor);
+void sem_asignar_operando(operando destino, atributos valor);
+void sem_asignar_array(atomo* nombre_array, atributos indice, atributos valor);
 void sem_imprimir_expresion(atributos s);
-void sem_declarar(int tipo, char* nombre);
-void sem_declarar_array(int tipo, char* nombre, int tamanyo);
+void sem_declarar(int tipo, atomo* nombre);
+void sem_declarar_array(int tipo, atomo* nombre, int tamanyo);
 
 // Operaciones booleanas
-atributos sem_operar_relacional(atributos A, atributos B, char* op);
+atributos sem_operar_relacional(atributos A, atributos B, op_rel op);
 
 
-// Gestión de SWITCH
-void sem_push_switch(char* nombre_var); /* Entramos a un switch */
+// Gestión de SWITCH: los cuerpos se emiten según se leen y al cerrar el
+// switch se colocan detrás del código que elige el caso
+void sem_push_switch(atributos var);    /* Entramos a un switch */
 void sem_pop_switch();                  /* Salimos de un switch */
-char* sem_get_switch_var();             /* ¿Qué variable estamos comparando? */
+void sem_anyadir_caso(int valor);       /* 'case valor:' empieza aquí */
+void sem_anyadir_default();             /* 'default:' empieza aquí */
+int sem_generar_switch();               /* Despacho + cuerpos; devuelve la salida */
 
 // Aux gestión bucle/switch
 void sem_init_break_layer();
 void sem_close_break_layer(int etiqueta_destino);
 void sem_add_break();
 
-// Loop unrolling
-void sem_start_record();
-char* sem_stop_record();
-void sem_emitir_bloque(char* bloque);
+// Loop unrolling: el cuerpo se emite normalmente desde la marca que
+// devuelve sem_start_record; sem_stop_record lo copia y lo quita del buffer
+int sem_start_record();
+bloque_quads sem_stop_record(int inicio);
+void sem_emitir_bloque(bloque_quads bloque);  /* Copia con los saltos recolocados */
+void sem_liberar_bloque(bloque_quads bloque);
+void sem_liberar_lista(lista_nodos* lista);
+
+// Cierre de los bucles (desenrollando si conviene). Devuelven la etiqueta de salida
+int sem_generar_repeat(bloque_quads cuerpo, atributos veces);
+int sem_generar_for(cabecera_for cab, int inicio_cuerpo);
+
+// Errores semánticos: se informan como los de sintaxis (en calculadora.y)
+void sem_error(const char *s);
 
-// Utilidad
-void yyerror(const char *s);
+// Quad que la máquina virtual o la traducción a C no saben tratar ('cerca'
+// puede ser NULL); se informa como los demás errores (en calculadora.y)
+void sem_error_quad(int quad, const char *s, const char *cerca);
 
 #endif
\ No newline at end of file
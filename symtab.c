@@ -37,16 +37,35 @@ struct sym_binding
 #endif
     };
 
-/* Array of hash buckets */
-static struct sym_binding *hash_table[SYM_BUCKET_MAX] = { NULL };
+/* Open addressing hash table for the global scope.  A slot is either      */
+/* NULL (never used), SYM_DELETED (binding removed, keep probing) or a      */
+/* pointer to a binding.  Bindings in the table do not use their next field.*/
+/* All the mutable state is thread local: each thread has its own table.  */
+static _Thread_local struct sym_binding **hash_table = NULL;
+static _Thread_local unsigned hash_capacity = 0;  /* number of slots, power of 2 */
+static _Thread_local unsigned hash_live = 0;      /* slots holding a binding     */
+static _Thread_local unsigned hash_deleted = 0;   /* slots holding SYM_DELETED   */
+
+static struct sym_binding deleted_marker;
+#define SYM_DELETED (&deleted_marker)
+
+/* Probe statistics, reported by sym_histogram and sym_estadisticas.        */
+static _Thread_local unsigned long lookup_count = 0;
+static _Thread_local unsigned long probe_searches = 0;
+static _Thread_local unsigned long probe_total = 0;
+static _Thread_local unsigned probe_max = 0;
+
+/* Set by lookup_binding: non-zero if the returned pointer is a table slot  */
+/* rather than a link of a scope's linked list.                             */
+static _Thread_local int ptr_in_table;
 
 /* The following two declarations are parameters that are passed to         */
 /* search_linked_list as global data.  This is for the convenience of       */
 /* sym_lookup which may call search_linked_list multiple times as it        */
 /* searches through nested scopes.                                          */
-static const char *my_name;
+static _Thread_local const char *my_name;
 #ifdef SYM_MULTIPLE_NAME_SPACES
-static unsigned my_name_space;          /* local copy of name space param   */
+static _Thread_local unsigned my_name_space;          /* local copy of name space param   */
 #endif
 
 #ifdef SYM_DEEP_BINDING
@@ -56,7 +75,7 @@ static unsigned my_name_space;          /* local copy of name space param   */
 /* Nested scopes follow stack discipline.  */
 
 /* The nested scope stack.  */
-static struct sym_binding *scope_stack[SYM_SCOPE_STACK_DEPTH];
+static _Thread_local struct sym_binding *scope_stack[SYM_SCOPE_STACK_DEPTH];
 
 #ifndef SYM_NO_CHECK_POP
 /* Array paralel to scope_stack.                                            */
@@ -64,7 +83,7 @@ static struct sym_binding *scope_stack[SYM_SCOPE_STACK_DEPTH];
 /* If an element contains 0 it is above the top of stack.                   */
 /*                        1 it is at the top of stack.                      */
 /*                        2 it is below the top of stack.                   */
-static short scope_level[SYM_SCOPE_STACK_DEPTH] = {0};
+static _Thread_local short scope_level[SYM_SCOPE_STACK_DEPTH] = {0};
 #endif
 
 /* #define to return a pointer to a non-global scope given a scope_id.  */
@@ -95,43 +114,173 @@ static short scope_level[SYM_SCOPE_STACK_DEPTH] = {0};
 #endif/* #endif #ifdef SYM_SCOPE_STACK_DEPTH  */
 
 /* The current scope.  Initialized to be the global scope.  */
-static sym_scope_id scope_pointer = SYM_ROOT_SCOPE;
-
-/* Pointer provides external read access to scope_pointer.  */
-const sym_scope_id *const current_scope = &scope_pointer;
+static _Thread_local sym_scope_id scope_pointer = SYM_ROOT_SCOPE;
 
 #endif/* #ifdef SYM_DEEP_BINDING */
 
 
-/* Compute addess of pointer to hash bucket                                 */
-static struct sym_binding ** hash_bucket(void)
+/* Hash of my_name: FNV-1a over the characters followed by the MurmurHash3 */
+/* 32 bit finalizer, so that names differing only in their last digits     */
+/* (v1, v2, ... v99999) spread over the whole table.                        */
+static unsigned hash_name(void)
     {
-    register unsigned hash_sum;
-    const char * s = my_name;
+    register unsigned h = 2166136261u;
+    const unsigned char * s = (const unsigned char *)my_name;
 
-    hash_sum = *s;
-    while (*s++)                        /* Compute hash sum                 */
+    while (*s)
         {
-        hash_sum = (hash_sum << 1) ^ *s;
+        h ^= *s++;
+        h *= 16777619u;
+        }
+#ifdef SYM_MULTIPLE_NAME_SPACES
+    h ^= my_name_space * 0x9e3779b9u;
+#endif
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+    }
+
+/* Look for my_name in the global table.  If found, set parameter to the    */
+/* slot holding its binding and return 0.  Otherwise set it to the slot a   */
+/* new binding should go into (the first deleted slot seen, or the empty    */
+/* slot that ended the search) and return 1.  The table must exist.         */
+static int probe_table(struct sym_binding ***const ptr)
+    {
+    unsigned mask = hash_capacity - 1;
+    unsigned i = hash_name() & mask;
+    unsigned probes = 1;
+    struct sym_binding **reuse = NULL;
+    int rc;
+
+    for (;; i = (i + 1) & mask, probes++)
+        {
+        struct sym_binding *sym = hash_table[i];
+
+        if (sym == NULL)
+            {
+            *ptr = reuse ? reuse : hash_table + i;
+            rc = 1;
+            break;
+            }
+        if (sym == SYM_DELETED)
+            {
+            if (reuse == NULL)
+                reuse = hash_table + i;
+            continue;
+            }
+        if (
+#ifdef SYM_MULTIPLE_NAME_SPACES
+            sym->name_space == my_name_space &&
+#endif
+                    SYM_COMPARE_NAME_FUNCTION(sym->name, my_name) == 0 )
+            {
+            *ptr = hash_table + i;
+            rc = 0;
+            break;
+            }
         }
 
-    /* Map hash_sum into a hash bucket index.  This is done using the %     */
-    /* operator.  Depending on the application and the C compiler, the time */
-    /* required to perform the % operation may not be small in comparison   */
-    /* to the time spent searching a hash bucket.  In this case, the        */
-    /* performance can be tweaked by making SYM_BUCKET_MAX a power of 2 and */
-    /* changing                                                             */
-    /* % SYM_BUCKET_MAX                                                     */
-    /* in the following two statements to be                                */
-    /* & the_base_2_log_of_SYM_BUCKET_MAX                                   */
+    probe_searches++;
+    probe_total += probes;
+    if (probes > probe_max)
+        probe_max = probes;
+    return rc;
+    }
+
+/* Re-insert every live binding into a table of new_capacity slots.         */
+/* Deleted markers are dropped.  Returns SYMTAB_OK or SYMTAB_NO_MEMORY.     */
+static int rehash_table(unsigned new_capacity)
+    {
+    struct sym_binding **old_table = hash_table;
+    unsigned old_capacity = hash_capacity;
+    const char *saved_name = my_name;
 #ifdef SYM_MULTIPLE_NAME_SPACES
-    return hash_table + (hash_sum + my_name_space) % SYM_BUCKET_MAX;
-#else
-    return hash_table + hash_sum % SYM_BUCKET_MAX;
+    unsigned saved_name_space = my_name_space;
+#endif
+    unsigned i;
+
+    hash_table = (struct sym_binding **)
+                calloc(new_capacity, sizeof(struct sym_binding *));
+    if (hash_table == NULL)
+        {
+        hash_table = old_table;
+        return SYMTAB_NO_MEMORY;
+        }
+    hash_capacity = new_capacity;
+    hash_deleted = 0;
+
+    for (i = 0; i < old_capacity; i++)
+        {
+        struct sym_binding *sym = old_table[i];
+        unsigned j;
+
+        if (sym == NULL || sym == SYM_DELETED)
+            continue;
+        my_name = sym_extract_name(sym->name);
+#ifdef SYM_MULTIPLE_NAME_SPACES
+        my_name_space = sym->name_space;
+#endif
+        j = hash_name() & (new_capacity - 1);
+        while (hash_table[j] != NULL)
+            j = (j + 1) & (new_capacity - 1);
+        hash_table[j] = sym;
+        }
+
+    my_name = saved_name;
+#ifdef SYM_MULTIPLE_NAME_SPACES
+    my_name_space = saved_name_space;
 #endif
+    free(old_table);
+    return SYMTAB_OK;
+    }
+
+/* Make sure one more binding fits without exceeding the load factor.       */
+static int reserve_table_slot(void)
+    {
+    if (hash_table == NULL)
+        return rehash_table(SYM_INITIAL_CAPACITY);
+    if ((hash_live + hash_deleted + 1) * 100 > hash_capacity * SYM_MAX_LOAD_PERCENT)
+        {
+        /* Mostly deleted markers: clean up in place instead of growing     */
+        if ((hash_live + 1) * 200 <= hash_capacity * SYM_MAX_LOAD_PERCENT)
+            return rehash_table(hash_capacity);
+        return rehash_table(hash_capacity * 2);
+        }
+    return SYMTAB_OK;
     }
 
-/* Search a non-global scope or a hash bucket for binding with given name.  */
+/* Insert a new binding at the place found by lookup_binding.               */
+static void link_binding(struct sym_binding **ptr, struct sym_binding *sym)
+    {
+    if (ptr_in_table)
+        {
+        if (*ptr == SYM_DELETED)
+            hash_deleted--;
+        hash_live++;
+        sym->next = NULL;
+        }
+    else
+        sym->next = *ptr;
+    *ptr = sym;
+    }
+
+/* Remove the binding found by lookup_binding (does not free it).           */
+static void unlink_binding(struct sym_binding **ptr)
+    {
+    if (ptr_in_table)
+        {
+        *ptr = SYM_DELETED;
+        hash_live--;
+        hash_deleted++;
+        }
+    else
+        *ptr = (*ptr)->next;
+    }
+
+/* Search a non-global scope for binding with given name.                   */
 static int search_linked_list(struct sym_binding ***const ptr)
     {
     struct sym_binding **sym;
@@ -168,7 +317,7 @@ static int search_linked_list(struct sym_binding ***const ptr)
 /* Find binding. Sets parameter to a pointer to a pointer to the binding if */
 /* the binding is found.  Otherwise, to a pointer to a pointer in the scope */
 /* that should be set if a new binding is to be computed.                   */
-/* Returns 0 if binding is found, 1 if not.                                 */
+/* Returns 0 if binding is found, 1 if not, -1 if out of memory.            */
 #ifdef SYM_MULTIPLE_NAME_SPACES
 static int lookup_binding(sym_name_type name,
                           struct sym_binding ***ptr,
@@ -185,18 +334,23 @@ static int lookup_binding(sym_name_type name,
 
 #ifdef SYM_DEEP_BINDING
     if (scope_pointer != SYM_ROOT_SCOPE)
+        {
 #ifdef SYM_SCOPE_STACK_DEPTH
         *ptr = scope_stack + scope_pointer;
 #else
         *ptr = &scope_pointer->linked_list;
 #endif
-    else
+        ptr_in_table = 0;
+        return search_linked_list(ptr);
+        }
 #endif
-        /* Find hash bucket */
-        *ptr = hash_bucket();
 
-    /* Look for binding in bucket                                           */
-    return search_linked_list(ptr);
+    /* Global scope: look for binding in the hash table.  Room for one more */
+    /* binding is made first, so that the returned slot stays valid.        */
+    if (reserve_table_slot() != SYMTAB_OK)
+        return -1;
+    ptr_in_table = 1;
+    return probe_table(ptr);
     }
 
 
@@ -216,11 +370,16 @@ int sym_add(sym_name_type  name, sym_value_type *value)
     {
     struct sym_binding **ptr, *sym;
 
+    int rc;
+
 #ifdef SYM_MULTIPLE_NAME_SPACES
-    if (!lookup_binding(name, &ptr, name_space))
+    rc = lookup_binding(name, &ptr, name_space);
 #else
-    if (!lookup_binding(name, &ptr))
+    rc = lookup_binding(name, &ptr);
 #endif
+    if (rc < 0)
+        return SYMTAB_NO_MEMORY;
+    if (rc == 0)
         return SYMTAB_DUPLICATE;
 
     /* Not found in symbol table so create a new symble table entry.        */
@@ -242,9 +401,8 @@ int sym_add(sym_name_type  name, sym_value_type *value)
     SYM_ADD_NAME_BOOKKEEPING(name);
     SYM_ADD_VALUE_BOOKKEEPING(value);
 
-    /* Insert into linked list                                              */
-    sym->next = *ptr;
-    *ptr = sym;
+    /* Insert into table or linked list                                     */
+    link_binding(ptr, sym);
 
     return SYMTAB_OK;                   /* All's well that ends well.       */
     }
@@ -259,12 +417,16 @@ int sym_enter(sym_name_type  name, sym_value_type *value)
 #endif
     {
     struct sym_binding **ptr;
+    int rc;
 
 #ifdef SYM_MULTIPLE_NAME_SPACES
-    if (lookup_binding(name, &ptr, name_space))
+    rc = lookup_binding(name, &ptr, name_space);
 #else
-    if (lookup_binding(name, &ptr))
+    rc = lookup_binding(name, &ptr);
 #endif
+    if (rc < 0)
+        return SYMTAB_NO_MEMORY;
+    if (rc)
         { /* Not found in symbol table so create a new symbol table entry.  */
         struct sym_binding *sym;
 
@@ -286,9 +448,8 @@ int sym_enter(sym_name_type  name, sym_value_type *value)
         SYM_ADD_VALUE_BOOKKEEPING(value);
         SYM_ADD_NAME_BOOKKEEPING(name);
 
-        /* Insert into linked list                                          */
-        sym->next = *ptr;
-        *ptr = sym;
+        /* Insert into table or linked list                                 */
+        link_binding(ptr, sym);
 
         return SYMTAB_OK;               /* Binding successfully created.    */
         }
@@ -328,6 +489,7 @@ int sym_lookup(sym_name_type  name,
 
     sym_scope_id scope;
 
+    lookup_count++;
     my_name = sym_extract_name(name);
 #ifdef SYM_MULTIPLE_NAME_SPACES
     my_name_space = name_space;
@@ -343,17 +505,16 @@ int sym_lookup(sym_name_type  name,
             goto exit;
             }
         }
-    ptr = hash_bucket();
-    if (search_linked_list(&ptr))
+    if (hash_table == NULL || probe_table(&ptr))
         return SYMTAB_NOT_FOUND;
 
 exit:
 #else
 
 #ifdef SYM_MULTIPLE_NAME_SPACES
-    if (lookup_binding(name, &ptr, name_space))
+    if (lookup_binding(name, &ptr, name_space) != 0)
 #else
-    if (lookup_binding(name, &ptr))
+    if (lookup_binding(name, &ptr) != 0)
 #endif
         return SYMTAB_NOT_FOUND;
 
@@ -373,9 +534,9 @@ int sym_remove(sym_name_type  name)
     struct sym_binding **ptr, *tmp;
 
 #ifdef SYM_MULTIPLE_NAME_SPACES
-    if (lookup_binding(name, &ptr, name_space))
+    if (lookup_binding(name, &ptr, name_space) != 0)
 #else
-    if (lookup_binding(name, &ptr))
+    if (lookup_binding(name, &ptr) != 0)
 #endif
         return SYMTAB_NOT_FOUND;
 
@@ -386,7 +547,7 @@ int sym_remove(sym_name_type  name)
 #else
     SYM_REMOVE_VALUE_BOOKKEEPING(&tmp->value);
 #endif
-    *ptr = (*ptr)->next;
+    unlink_binding(ptr);
     free(tmp);
     return SYMTAB_OK;
     }
@@ -462,30 +623,102 @@ int sym_pop_scope(void)
     }
 #endif/* SYM_DEEP_BINDING */
 
+#ifdef SYM_DEEP_BINDING
+/* Read access to the current scope.                                        */
+sym_scope_id sym_get_scope(void)
+    {
+    return scope_pointer;
+    }
+#endif
+
+
+/* Remove every binding, pop every scope and release the global table, so  */
+/* that the thread can start over with another program.                    */
+void sym_clear(void)
+    {
+    unsigned i;
+
+#ifdef SYM_DEEP_BINDING
+    while (scope_pointer != SYM_ROOT_SCOPE)
+        {
+#ifndef SYM_NO_CHECK_POP
+        sym_set_level(scope_pointer, 1);
+#endif
+        sym_pop_scope();
+        }
+#endif
+    for (i = 0; i < hash_capacity; i++)
+        {
+        struct sym_binding *sym = hash_table[i];
+
+        if (sym == NULL || sym == SYM_DELETED)
+            continue;
+        SYM_REMOVE_NAME_BOOKKEEPING(sym->name);
+#ifdef SYM_POINTS_TO_VALUE
+        SYM_REMOVE_VALUE_BOOKKEEPING(sym->value);
+#else
+        SYM_REMOVE_VALUE_BOOKKEEPING(&sym->value);
+#endif
+        free(sym);
+        }
+    free(hash_table);
+    hash_table = NULL;
+    hash_capacity = hash_live = hash_deleted = 0;
+    lookup_count = probe_searches = probe_total = 0;
+    probe_max = 0;
+    }
+
+
+/* Number of sym_lookup calls and probes done by every search of the       */
+/* global table (lookups, adds and removes).                               */
+void sym_estadisticas(unsigned long *lookups, unsigned long *probes)
+    {
+    *lookups = lookup_count;
+    *probes = probe_total;
+    }
+
 
 #ifdef SYM_HISTOGRAM
 #ifndef BUFSIZ
 #include <stdio.h>
 #endif
-/* Displays a histogram of the sizes of the global hash buckets.            */
+/* Displays occupancy of the global hash table, a histogram of how many     */
+/* probes each live binding needs to be found, and the probe counts of the  */
+/* searches done so far.                                                    */
+#define SYM_HISTOGRAM_MAX 16
 void sym_histogram()
     {
-    int i;
+    unsigned long counts[SYM_HISTOGRAM_MAX + 1] = { 0 };
+    unsigned i;
+
+    printf("table: %u slots, %u live, %u deleted, load %.1f%%\n",
+           hash_capacity, hash_live, hash_deleted,
+           hash_capacity ? 100.0 * (hash_live + hash_deleted) / hash_capacity : 0.0);
 
-    for (i = 0; i < SYM_BUCKET_MAX ; i++)
+    for (i = 0; i < hash_capacity; i++)
         {
-        struct sym_binding *b;
-        unsigned j;
+        struct sym_binding *sym = hash_table[i];
+        unsigned home, probes;
 
-        b = hash_table[i];
-        j = 0;
-        while (b)
-            {
-            j += 1;
-            b = b->next;
-            }
-        printf("bucket %d contains %u\n", i, j);
+        if (sym == NULL || sym == SYM_DELETED)
+            continue;
+        my_name = sym_extract_name(sym->name);
+#ifdef SYM_MULTIPLE_NAME_SPACES
+        my_name_space = sym->name_space;
+#endif
+        home = hash_name() & (hash_capacity - 1);
+        probes = ((i - home) & (hash_capacity - 1)) + 1;
+        counts[probes < SYM_HISTOGRAM_MAX ? probes : SYM_HISTOGRAM_MAX]++;
         }
+    for (i = 1; i <= SYM_HISTOGRAM_MAX; i++)
+        if (counts[i])
+            printf("%s%u probes: %lu bindings\n",
+                   i == SYM_HISTOGRAM_MAX ? ">=" : "", i, counts[i]);
+
+    printf("searches: %lu, average probes %.2f, longest %u\n",
+           probe_searches,
+           probe_searches ? (double)probe_total / probe_searches : 0.0,
+           probe_max);
     }
 #endif
 
@@ -568,11 +801,8 @@ int sym_global_lookup(sym_name_type  name,
     my_name_space = name_space;
 #endif
 
-    /* Find hash bucket */
-    ptr = hash_bucket();
-
-    /* Look for binding in bucket                                           */
-    if (search_linked_list(&ptr))
+    /* Look for binding in the hash table                                   */
+    if (hash_table == NULL || probe_table(&ptr))
         return SYMTAB_NOT_FOUND;
     *value = (*ptr)->value;
     return SYMTAB_OK;
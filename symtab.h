@@ -36,6 +36,8 @@ typedef struct {
         char *valor_str;    // Para cadenas
     } u;
 
+    int tamanyo;        // Elementos si es un array (0 si no lo es)
+
     /* Campos para cuando tipo == T_PLANTILLA */
     char* campos[MAX_CAMPOS];
     int tipos_campos[MAX_CAMPOS];
@@ -94,18 +96,18 @@ typedef const char * sym_name_type;     /* If you are using something other */
 
 
 /****************************************************************************/
-/* SYM_BUCKET_MAX, defined below, is the number of buckets in the hash      */
-/* table.  For best results, SYM_BUCKET_MAX should be a prime number.  For  */
-/* your convenience, a selection of arbitrarily selected prime numbers      */
-/* appears below.                                                           */
-/* 97   157  223  269  307  359  409  461  509  563  613  661  727  797     */
-/* 853  907  967  1019 1069 1097 1297 1381 1433 1483 1543 1597 1657 1709    */
-/* 1723 1777 1847 1901 1951 2003 2053 2113 2179 2239 2293 2411 2503 2633    */
+/* The global scope is an open addressing hash table with linear probing.   */
+/* SYM_INITIAL_CAPACITY, defined below, is the number of slots allocated    */
+/* by the first insertion.  It must be a power of 2.  The table doubles     */
+/* whenever live entries plus deleted markers would exceed                  */
+/* SYM_MAX_LOAD_PERCENT of its slots, so there is no limit on the number    */
+/* of global names.                                                         */
 /****************************************************************************/
 
-#define SYM_BUCKET_MAX 263
-		/*nombre max d'entrades de la taula de dispersio que contindra*/
-		/*les variables globals. Canviar si se'n volen mes.*/
+#define SYM_INITIAL_CAPACITY 256
+#define SYM_MAX_LOAD_PERCENT 50
+		/*La taula de variables globals creix sola: no cal canviar-ho*/
+		/*per tenir-ne mes.*/
 
 /* Uncomment SYM_MULTIPLE_NAME_SPACES to support multiple name spaces.      */
 /* #define SYM_MULTIPLE_NAME_SPACES */
@@ -164,7 +166,8 @@ typedef const char * sym_name_type;     /* If you are using something other */
 /* #define SYM_REQUIRE_GLOBAL                                               */
 
 
-/* Uncomment the following to include sym_histogram in the compile          */
+/* Uncomment the following to include sym_histogram in the compile.         */
+/* It reports table occupancy and the distribution of probe lengths.        */
 /* #define SYM_HISTOGRAM */
 
 
@@ -205,8 +208,7 @@ int sym_pop_scope(void);
 #define sym_prev_scope(x) ((x)->previous_scope)
 #endif
 
-extern const sym_scope_id *const current_scope;
-#define sym_get_scope() (*current_scope);
+sym_scope_id sym_get_scope(void);
 #endif
 
 
@@ -248,6 +250,11 @@ int sym_remove(sym_name_type  name, unsigned name_space);
 int sym_remove(sym_name_type  name);
 #endif
 
+void sym_estadisticas(unsigned long *lookups, unsigned long *probes);
+
+/* Empty the table (the state is per thread) to compile another program     */
+void sym_clear(void);
+
 #ifdef SYM_HISTOGRAM
 void sym_histogram();
 #endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include "traza.h"
+
+/* Cada hilo lleva la traza del programa que compila */
+_Thread_local unsigned traza_categorias = 0;
+static _Thread_local evento_traza eventos[TRAZA_CAPACIDAD];
+static _Thread_local unsigned num_eventos = 0;  /* Registrados en total */
+static _Thread_local int hay_error = 0;
+
+/* Los mensajes de error pueden venir de un buffer temporal: se copian a
+   un anillo propio, más pequeño que el de eventos */
+#define MAX_MENSAJES 64
+#define LONG_MENSAJE 120
+static _Thread_local char mensajes[MAX_MENSAJES][LONG_MENSAJE];
+static _Thread_local unsigned num_mensajes = 0;
+
+static const struct {
+    const char* nombre;
+    int categoria;
+} categorias[] = {
+    { "reglas",    TRAZA_REGLAS },
+    { "backpatch", TRAZA_BACKPATCH },
+    { "pasadas",   TRAZA_PASADAS },
+    { "errores",   TRAZA_ERRORES },
+};
+#define NUM_CATEGORIAS ((int)(sizeof(categorias) / sizeof(categorias[0])))
+
+/* --- OPCIONES --- */
+
+static int seleccionar(opciones_traza* op, const char* lista) {
+    unsigned mascara = 0;
+    const char* p = lista;
+    while (*p) {
+        const char* fin = strchr(p, ',');
+        size_t len = fin ? (size_t)(fin - p) : strlen(p);
+        int encontrada = 0;
+        for (int c = 0; c < NUM_CATEGORIAS; c++) {
+            if (strlen(categorias[c].nombre) == len && strncmp(categorias[c].nombre, p, len) == 0) {
+                mascara |= categorias[c].categoria;
+                encontrada = 1;
+            }
+        }
+        if (!encontrada && len > 0) {
+            fprintf(stderr, "Error: Categoría de traza desconocida '%.*s' (reglas, backpatch, pasadas, errores)\n",
+                    (int)len, p);
+            return 0;
+        }
+        p += len;
+        if (*p == ',') p++;
+    }
+    op->categorias = mascara ? mascara : TRAZA_TODAS;
+    return 1;
+}
+
+int traza_procesar_opcion(opciones_traza* op, const char* arg) {
+    if (strcmp(arg, "--trace") == 0) {
+        op->categorias = TRAZA_TODAS;
+        return 1;
+    }
+    if (strncmp(arg, "--trace=", 8) == 0) {
+        return seleccionar(op, arg + 8) ? 1 : -1;
+    }
+    if (strncmp(arg, "--log=", 6) == 0) {
+        if (!arg[6]) {
+            fprintf(stderr, "Error: Falta el fichero en --log=\n");
+            return -1;
+        }
+        op->fichero = arg + 6;
+        if (!op->categorias) op->categorias = TRAZA_TODAS;
+        return 1;
+    }
+    return 0;
+}
+
+/* --- REGISTRO --- */
+
+void traza_reiniciar(const opciones_traza* op) {
+    traza_categorias = op->categorias;
+    num_eventos = 0;
+    num_mensajes = 0;
+    hay_error = 0;
+}
+
+void traza_registrar(int categoria, int linea, const char* texto, int a, int b) {
+    evento_traza* e = &eventos[num_eventos & (TRAZA_CAPACIDAD - 1)];
+    e->secuencia = num_eventos++;
+    e->categoria = categoria;
+    e->linea = linea;
+    e->a = a;
+    e->b = b;
+    e->texto = texto;
+}
+
+void traza_error(int linea, const char* texto, int a) {
+    if (!traza_categorias) return;
+    hay_error = 1;
+    char* copia = mensajes[num_mensajes % MAX_MENSAJES];
+    snprintf(copia, LONG_MENSAJE, "%s", texto);
+    traza_registrar(TRAZA_ERRORES, linea, copia, a, (int)num_mensajes++);
+}
+
+/* --- VOLCADO --- */
+
+static const char* nombre_categoria(int categoria) {
+    for (int c = 0; c < NUM_CATEGORIAS; c++) {
+        if (categorias[c].categoria == categoria) return categorias[c].nombre;
+    }
+    return "?";
+}
+
+static void escribir_evento(FILE* out, const evento_traza* e) {
+    fprintf(out, "#%06u %-9s ", e->secuencia, nombre_categoria(e->categoria));
+    if (e->linea) fprintf(out, "l.%-5d ", e->linea);
+    else fprintf(out, "%-7s ", "-");
+    switch (e->categoria) {
+        case TRAZA_REGLAS:    fprintf(out, "Regla: %s\n", e->texto); break;
+        case TRAZA_BACKPATCH: fprintf(out, "%d saltos -> %d\n", e->a, e->b); break;
+        case TRAZA_PASADAS:   fprintf(out, "%s: %d -> %d quads\n", e->texto, e->a, e->b); break;
+        case TRAZA_ERRORES:
+            /* 'b' es el número del mensaje: si es antiguo su hueco ya se ha reutilizado */
+            if (num_mensajes - (unsigned)e->b > MAX_MENSAJES) fprintf(out, "ERROR (%d)\n", e->a);
+            else fprintf(out, "ERROR: %s (%d)\n", e->texto, e->a);
+            break;
+        default:              fprintf(out, "%s %d %d\n", e->texto, e->a, e->b); break;
+    }
+}
+
+int traza_finalizar(const char* fichero) {
+    if (!traza_categorias || (!fichero && !hay_error)) return 0;
+    FILE* out = fichero ? fopen(fichero, "w") : stderr;
+    if (!out) return 1;     /* Lo informa quien llama (con errno) */
+    if (out == stderr) flockfile(out);
+    unsigned primero = num_eventos > TRAZA_CAPACIDAD ? num_eventos - TRAZA_CAPACIDAD : 0;
+    fprintf(out, "--- Traza: %u eventos", num_eventos);
+    if (primero) fprintf(out, " (se conservan los %d últimos)", TRAZA_CAPACIDAD);
+    fputs(" ---\n", out);
+    for (unsigned s = primero; s < num_eventos; s++) {
+        escribir_evento(out, &eventos[s & (TRAZA_CAPACIDAD - 1)]);
+    }
+    if (out != stderr) fclose(out);
+    else funlockfile(out);
+    return 0;
+}
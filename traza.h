@@ -0,0 +1,60 @@
+#ifndef TRAZA_H
+#define TRAZA_H
+
+/* Traza interna del compilador (--trace, --log): eventos de tamaño fijo en
+   un buffer circular en memoria que solo se escribe al final si se ha
+   pedido un fichero (--log) o si ha habido un error. Sin --trace ni --log
+   cada punto de traza es una comprobación de una máscara. Las categorías
+   y el buffer son de cada hilo. */
+
+#define TRAZA_CAPACIDAD 4096    // Eventos que se conservan (los últimos)
+
+typedef enum {
+    TRAZA_REGLAS    = 1 << 0,   // Reducciones de la gramática (log_regla)
+    TRAZA_BACKPATCH = 1 << 1,   // Listas de saltos rellenadas
+    TRAZA_PASADAS   = 1 << 2,   // Pasadas de optimización (quads antes y después)
+    TRAZA_ERRORES   = 1 << 3,   // Errores de sintaxis y de ejecución
+    TRAZA_TODAS     = (1 << 4) - 1
+} categoria_traza;
+
+typedef struct {
+    unsigned secuencia;         // Número del evento desde el principio
+    int categoria;
+    int linea;                  // Línea del fuente (0 si no viene de él)
+    int a, b;                   // Datos del evento (según la categoría)
+    const char* texto;          // Cadena estática: no se copia
+} evento_traza;
+
+// Opciones de la traza
+typedef struct {
+    unsigned categorias;        // Las que se registran (0: traza apagada)
+    const char* fichero;        // --log (NULL si no se ha dado)
+} opciones_traza;
+
+// Categorías de la compilación del hilo
+extern _Thread_local unsigned traza_categorias;
+
+#define TRAZA(cat, linea, texto, a, b) \
+    do { if (traza_categorias & (cat)) traza_registrar((cat), (linea), (texto), (a), (b)); } while (0)
+
+// Trata --trace, --trace=cat1,cat2 y --log=fichero cambiando 'op' (1 si era
+// suya, 0 si no, -1 si es errónea). --log sin --trace registra todas las
+// categorías.
+int traza_procesar_opcion(opciones_traza* op, const char* arg);
+
+// Vacía el buffer del hilo al empezar un programa y registra desde ahí las
+// categorías de 'op' (el fichero lo da quien llama a traza_finalizar)
+void traza_reiniciar(const opciones_traza* op);
+
+void traza_registrar(int categoria, int linea, const char* texto, int a, int b);
+
+// Registra un error (si la traza está activa) y hace que se vuelque al final.
+// El texto se copia (puede ser un buffer temporal).
+void traza_error(int linea, const char* texto, int a);
+
+// Vuelca el buffer al fichero si se da (--log) o, si no, a stderr cuando
+// ha habido un error. Devuelve 0, o 1 si el fichero no se puede abrir
+// (con errno; el mensaje lo da quien llama).
+int traza_finalizar(const char* fichero);
+
+#endif
@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "vm.h"
+#include "semantica.h"
+#include "symtab.h"
+
+/* La memoria de la máquina es un vector de huecos de 32 bits: el 0 no se
+   usa, luego los temporales ($t01 es el 1) y detrás las variables y los
+   literales (cada valor distinto una sola vez) según van apareciendo.
+   Cada instrucción lleva ya los números de hueco de sus operandos, así que
+   al ejecutar no se busca ningún nombre. */
+
+/* Despacho por hilos (computed goto): cada instrucción guarda la dirección
+   del código que la ejecuta y salta directamente a la siguiente. Sin la
+   extensión de GCC se usa un switch. */
+#if defined(__GNUC__) && !defined(VM_SIN_HILOS)
+#define VM_HILOS 1
+#endif
+
+#define MAX_PARAMS 256          /* PARAM pendientes antes de un CALL */
+
+typedef union {
+    int i;
+    float f;
+} celda;
+
+/* Instrucciones de la máquina: las del C3A con el tipo y la relación ya
+   resueltos al cargar (un IFI LT es su propia instrucción) */
+typedef enum {
+    I_COPIA, I_I2F, I_F2I,
+    I_ADDI, I_ADDF, I_SUBI, I_SUBF, I_MULI, I_MULF,
+    I_DIVI, I_DIVF, I_MODI, I_POWI, I_POWF,
+    I_CHSI, I_CHSF,
+    I_CARGA, I_GUARDA,
+    I_IFI_EQ, I_IFI_NE, I_IFI_LT, I_IFI_LE, I_IFI_GT, I_IFI_GE,
+    I_IFF_EQ, I_IFF_NE, I_IFF_LT, I_IFF_LE, I_IFF_GT, I_IFF_GE,
+    I_GOTO, I_TABLA,
+    I_PARAM, I_PUTI, I_PUTF,
+    I_HALT, I_SIN_DESTINO,
+    NUM_INSTRUCCIONES
+} codigo_vm;
+
+typedef struct {
+    const void* manejador;  /* Código que la ejecuta (despacho por hilos) */
+    codigo_vm op;
+    int a, b, c;            /* Huecos (o array, o número de entradas/params) */
+    int destino;            /* Instrucción a la que salta */
+} instr_vm;
+
+typedef struct {
+    const char* nombre;
+    int tamanyo;            /* Elementos */
+} array_vm;
+
+/* Índice de búsqueda: clave -> hueco (o array), 0 = libre */
+typedef struct {
+    uint64_t* claves;
+    int* valores;
+    int cap;
+    int num;
+} tabla_huecos;
+
+struct programa_vm {
+    instr_vm* codigo;       /* Quads 1..num, el HALT final y el de los saltos rotos */
+    int num;
+    celda* inicial;         /* Memoria al empezar: ceros y los literales */
+    int num_huecos;
+    int cap_huecos;
+    array_vm* arrays;
+    int num_arrays;
+    int cap_arrays;
+    tabla_huecos variables;
+    tabla_huecos literales;
+    tabla_huecos nombres_arrays;
+};
+
+/* --- CARGA --- */
+
+static void* reservar(void* p, size_t tam) {
+    p = realloc(p, tam ? tam : 1);
+    if (!p) {
+        fprintf(stderr, "Error fatal: Sin memoria para la máquina virtual\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void* reservar_ceros(size_t num, size_t tam) {
+    void* p = calloc(num ? num : 1, tam);
+    if (!p) {
+        fprintf(stderr, "Error fatal: Sin memoria para la máquina virtual\n");
+        exit(1);
+    }
+    return p;
+}
+
+static unsigned mezclar(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (unsigned)x;
+}
+
+/* Valor guardado para 'clave' (0 si no estaba: el que llama lo rellena) */
+static int* buscar_clave(tabla_huecos* t, uint64_t clave) {
+    if (2 * (t->num + 1) > t->cap) {
+        tabla_huecos nueva = { NULL, NULL, t->cap ? t->cap * 2 : 256, 0 };
+        nueva.claves = reservar(NULL, sizeof(uint64_t) * nueva.cap);
+        nueva.valores = reservar_ceros(nueva.cap, sizeof(int));
+        for (int i = 0; i < t->cap; i++) {
+            if (t->valores[i]) *buscar_clave(&nueva, t->claves[i]) = t->valores[i];
+        }
+        free(t->claves);
+        free(t->valores);
+        *t = nueva;
+    }
+    unsigned h = mezclar(clave) & (t->cap - 1);
+    while (t->valores[h] && t->claves[h] != clave) h = (h + 1) & (t->cap - 1);
+    if (!t->valores[h]) {
+        t->claves[h] = clave;
+        t->num++;
+    }
+    return &t->valores[h];
+}
+
+static void liberar_tabla_huecos(tabla_huecos* t) {
+    free(t->claves);
+    free(t->valores);
+}
+
+static int nuevo_hueco(programa_vm* p, celda valor) {
+    if (p->num_huecos == p->cap_huecos) {
+        p->cap_huecos = p->cap_huecos ? p->cap_huecos * 2 : 1024;
+        p->inicial = reservar(p->inicial, sizeof(celda) * p->cap_huecos);
+    }
+    p->inicial[p->num_huecos] = valor;
+    return p->num_huecos++;
+}
+
+static int hueco_operando(programa_vm* p, const operando* o) {
+    celda v;
+    int* h;
+    switch (o->clase) {
+        case OPND_TEMP:
+            return o->u.temp;
+        case OPND_VAR:
+            h = buscar_clave(&p->variables, (uintptr_t)o->u.nombre);
+            v.i = 0;
+            break;
+        case OPND_ENTERO:
+            v.i = o->u.valor_int;
+            h = buscar_clave(&p->literales, (uint64_t)(uint32_t)v.i);
+            break;
+        case OPND_REAL:
+            v.f = o->u.valor_float;
+            h = buscar_clave(&p->literales, (1ULL << 32) | (uint32_t)v.i);
+            break;
+        default:
+            return 0;
+    }
+    if (!*h) *h = nuevo_hueco(p, v);
+    return *h;
+}
+
+/* Número de array (su tamaño sale de la declaración en la symtab) */
+static int array_operando(programa_vm* p, const operando* o) {
+    int* h = buscar_clave(&p->nombres_arrays, (uintptr_t)o->u.nombre);
+    if (*h) return *h - 1;
+
+    if (p->num_arrays == p->cap_arrays) {
+        p->cap_arrays = p->cap_arrays ? p->cap_arrays * 2 : 16;
+        p->arrays = reservar(p->arrays, sizeof(array_vm) * p->cap_arrays);
+    }
+    sym_value_type info;
+    array_vm* a = &p->arrays[p->num_arrays];
+    a->nombre = o->u.nombre;
+    a->tamanyo = sym_lookup(o->u.nombre, &info) == SYMTAB_OK ? info->tamanyo : 0;
+    *h = ++p->num_arrays;
+    return *h - 1;
+}
+
+static int es_real(const operando* o) {
+    return o->tipo == T_REAL;
+}
+
+/* Traduce el quad i. Devuelve 0 si la máquina no sabe ejecutarlo. */
+static int traducir(programa_vm* p, int i) {
+    const quad* q = sem_quad(i);
+    instr_vm* ins = &p->codigo[i];
+    int n = p->num;
+
+    ins->a = hueco_operando(p, &q->res);
+    ins->b = hueco_operando(p, &q->arg1);
+    ins->c = hueco_operando(p, &q->arg2);
+    ins->destino = q->destino >= 1 && q->destino <= n + 1 ? q->destino : n + 2;
+
+    switch (q->op) {
+        case OP_COPIA:
+            /* Entre tipos distintos la copia convierte */
+            if (es_real(&q->res) && q->arg1.tipo == T_ENTERO) ins->op = I_I2F;
+            else if (q->res.tipo == T_ENTERO && es_real(&q->arg1)) ins->op = I_F2I;
+            else ins->op = I_COPIA;
+            break;
+        case OP_ADDI: ins->op = I_ADDI; break;
+        case OP_ADDF: ins->op = I_ADDF; break;
+        case OP_SUBI: ins->op = I_SUBI; break;
+        case OP_SUBF: ins->op = I_SUBF; break;
+        case OP_MULI: ins->op = I_MULI; break;
+        case OP_MULF: ins->op = I_MULF; break;
+        case OP_DIVI: ins->op = I_DIVI; break;
+        case OP_DIVF: ins->op = I_DIVF; break;
+        case OP_MODI: ins->op = I_MODI; break;
+        case OP_POW:  ins->op = es_real(&q->arg1) ? I_POWF : I_POWI; break;
+        case OP_CHSI: ins->op = I_CHSI; break;
+        case OP_CHSF: ins->op = I_CHSF; break;
+        case OP_I2F:  ins->op = I_I2F; break;
+        case OP_CARGA_IDX:
+            ins->op = I_CARGA;
+            ins->b = array_operando(p, &q->arg1);
+            break;
+        case OP_GUARDA_IDX:
+            ins->op = I_GUARDA;
+            ins->a = array_operando(p, &q->res);
+            break;
+        case OP_IFI:
+        case OP_IFF:
+            ins->op = (q->op == OP_IFI ? I_IFI_EQ : I_IFF_EQ) + (q->rel - REL_EQ);
+            break;
+        case OP_GOTO:
+            ins->op = I_GOTO;
+            break;
+        case OP_GOTO_TABLA:
+            ins->op = I_TABLA;
+            ins->c = q->arg2.u.valor_int;
+            if (ins->c < 0 || i + ins->c > n) {
+                sem_error_quad(i, "Tabla de saltos incompleta", NULL);
+                return 0;
+            }
+            break;
+        case OP_PARAM:
+            ins->op = I_PARAM;
+            break;
+        case OP_CALL:
+            if (strcmp(q->arg1.u.nombre, "PUTI") == 0) ins->op = I_PUTI;
+            else if (strcmp(q->arg1.u.nombre, "PUTF") == 0) ins->op = I_PUTF;
+            else {
+                sem_error_quad(i, "Rutina desconocida", q->arg1.u.nombre);
+                return 0;
+            }
+            ins->c = q->arg2.u.valor_int;
+            break;
+        case OP_HALT:
+            ins->op = I_HALT;
+            break;
+        default:
+            sem_error_quad(i, "Operación desconocida", NULL);
+            return 0;
+    }
+    return 1;
+}
+
+programa_vm* vm_cargar() {
+    programa_vm* p = reservar_ceros(1, sizeof(programa_vm));
+    int n = sem_num_quads();
+    p->num = n;
+    p->codigo = reservar_ceros(n + 3, sizeof(instr_vm));
+
+    /* Hueco 0 y los temporales: valen 0 al empezar */
+    celda cero;
+    cero.i = 0;
+    for (int t = 0; t <= sem_num_temporales(); t++) nuevo_hueco(p, cero);
+
+    for (int i = 1; i <= n; i++) {
+        if (!traducir(p, i)) {
+            vm_liberar(p);
+            return NULL;
+        }
+    }
+    p->codigo[n + 1].op = I_HALT;          /* Se sale por el final */
+    p->codigo[n + 2].op = I_SIN_DESTINO;   /* GOTO sin rellenar */
+
+    liberar_tabla_huecos(&p->variables);
+    liberar_tabla_huecos(&p->literales);
+    liberar_tabla_huecos(&p->nombres_arrays);
+    memset(&p->variables, 0, sizeof(tabla_huecos));
+    memset(&p->literales, 0, sizeof(tabla_huecos));
+    memset(&p->nombres_arrays, 0, sizeof(tabla_huecos));
+    return p;
+}
+
+void vm_liberar(programa_vm* p) {
+    if (!p) return;
+    liberar_tabla_huecos(&p->variables);
+    liberar_tabla_huecos(&p->literales);
+    liberar_tabla_huecos(&p->nombres_arrays);
+    free(p->arrays);
+    free(p->inicial);
+    free(p->codigo);
+    free(p);
+}
+
+/* --- EJECUCIÓN --- */
+
+/* Misma semántica que el plegado de constantes: módulo 2^32 */
+static int potencia(int base, int exponente) {
+    unsigned r = 1, b = (unsigned)base;
+    while (exponente > 0) {
+        if (exponente & 1) r *= b;
+        b *= b;
+        exponente >>= 1;
+    }
+    return (int)r;
+}
+
+/* float -> int truncando; fuera de rango satura (NaN da 0) */
+static int a_entero(float x) {
+    if (x != x) return 0;
+    if (x >= 2147483648.0f) return INT_MAX;
+    if (x <= -2147483648.0f) return INT_MIN;
+    return (int)x;
+}
+
+#ifdef VM_HILOS
+#define INSTR(x)        op_##x:
+#define DESPACHAR()     goto *ip->manejador
+#else
+#define INSTR(x)        case I_##x:
+#define DESPACHAR()     continue
+#endif
+
+/* Sin do-while: en la versión con switch DESPACHAR es un continue */
+#define SIGUIENTE()     { ip++; DESPACHAR(); }
+#define SALTAR()        { ip = codigo + ip->destino; DESPACHAR(); }
+#define SI(cond)        { ip = (cond) ? codigo + ip->destino : ip + 1; DESPACHAR(); }
+#define FALLO(texto)    { error = (texto); goto fallo; }
+
+/* Acceso a v[desplazamiento / 4] comprobando el rango */
+#define ELEMENTO(arr, desp) \
+    (((desp) < 0 || ((desp) & 3) || ((desp) >> 2) >= p->arrays[arr].tamanyo) ? NULL : &datos[arr][(desp) >> 2])
+
+int vm_ejecutar(programa_vm* p, FILE* out, perfil* prf) {
+    instr_vm* codigo = p->codigo;
+#ifdef VM_HILOS
+    static const void* const manejadores[NUM_INSTRUCCIONES] = {
+        [I_COPIA] = &&op_COPIA, [I_I2F] = &&op_I2F, [I_F2I] = &&op_F2I,
+        [I_ADDI] = &&op_ADDI, [I_ADDF] = &&op_ADDF,
+        [I_SUBI] = &&op_SUBI, [I_SUBF] = &&op_SUBF,
+        [I_MULI] = &&op_MULI, [I_MULF] = &&op_MULF,
+        [I_DIVI] = &&op_DIVI, [I_DIVF] = &&op_DIVF, [I_MODI] = &&op_MODI,
+        [I_POWI] = &&op_POWI, [I_POWF] = &&op_POWF,
+        [I_CHSI] = &&op_CHSI, [I_CHSF] = &&op_CHSF,
+        [I_CARGA] = &&op_CARGA, [I_GUARDA] = &&op_GUARDA,
+        [I_IFI_EQ] = &&op_IFI_EQ, [I_IFI_NE] = &&op_IFI_NE, [I_IFI_LT] = &&op_IFI_LT,
+        [I_IFI_LE] = &&op_IFI_LE, [I_IFI_GT] = &&op_IFI_GT, [I_IFI_GE] = &&op_IFI_GE,
+        [I_IFF_EQ] = &&op_IFF_EQ, [I_IFF_NE] = &&op_IFF_NE, [I_IFF_LT] = &&op_IFF_LT,
+        [I_IFF_LE] = &&op_IFF_LE, [I_IFF_GT] = &&op_IFF_GT, [I_IFF_GE] = &&op_IFF_GE,
+        [I_GOTO] = &&op_GOTO, [I_TABLA] = &&op_TABLA,
+        [I_PARAM] = &&op_PARAM, [I_PUTI] = &&op_PUTI, [I_PUTF] = &&op_PUTF,
+        [I_HALT] = &&op_HALT, [I_SIN_DESTINO] = &&op_SIN_DESTINO
+    };
+    /* Con perfil todas las instrucciones entran por op_PERFIL */
+    for (int i = 1; i <= p->num + 2; i++) codigo[i].manejador = prf ? &&op_PERFIL : manejadores[codigo[i].op];
+#endif
+
+    /* Cada ejecución empieza con la memoria inicial y los arrays a cero */
+    celda* m = reservar(NULL, sizeof(celda) * p->num_huecos);
+    memcpy(m, p->inicial, sizeof(celda) * p->num_huecos);
+    celda** datos = reservar_ceros(p->num_arrays, sizeof(celda*));
+    for (int k = 0; k < p->num_arrays; k++) datos[k] = reservar_ceros(p->arrays[k].tamanyo, sizeof(celda));
+    celda params[MAX_PARAMS];
+    int num_params = 0;
+    const char* error = NULL;
+    int x, y;
+    celda* e;
+    int anterior = 0;           /* Quad ejecutado antes (para el perfil) */
+
+    instr_vm* ip = &codigo[1];
+#ifdef VM_HILOS
+    DESPACHAR();
+
+op_PERFIL:
+    perf_paso(prf, (int)(ip - codigo), anterior);
+    anterior = (int)(ip - codigo);
+    goto *manejadores[ip->op];
+#else
+    for (;;) {
+    if (prf) {
+        perf_paso(prf, (int)(ip - codigo), anterior);
+        anterior = (int)(ip - codigo);
+    }
+    switch (ip->op) {
+#endif
+
+    INSTR(COPIA) m[ip->a] = m[ip->b]; SIGUIENTE();
+    INSTR(I2F)   m[ip->a].f = (float)m[ip->b].i; SIGUIENTE();
+    INSTR(F2I)   m[ip->a].i = a_entero(m[ip->b].f); SIGUIENTE();
+
+    INSTR(ADDI)  m[ip->a].i = (int)((unsigned)m[ip->b].i + (unsigned)m[ip->c].i); SIGUIENTE();
+    INSTR(SUBI)  m[ip->a].i = (int)((unsigned)m[ip->b].i - (unsigned)m[ip->c].i); SIGUIENTE();
+    INSTR(MULI)  m[ip->a].i = (int)((unsigned)m[ip->b].i * (unsigned)m[ip->c].i); SIGUIENTE();
+    INSTR(ADDF)  m[ip->a].f = m[ip->b].f + m[ip->c].f; SIGUIENTE();
+    INSTR(SUBF)  m[ip->a].f = m[ip->b].f - m[ip->c].f; SIGUIENTE();
+    INSTR(MULF)  m[ip->a].f = m[ip->b].f * m[ip->c].f; SIGUIENTE();
+
+    INSTR(DIVI)
+        x = m[ip->b].i; y = m[ip->c].i;
+        if (y == 0) FALLO("división por cero");
+        m[ip->a].i = y == -1 ? (int)(0u - (unsigned)x) : x / y;
+        SIGUIENTE();
+    INSTR(MODI)
+        x = m[ip->b].i; y = m[ip->c].i;
+        if (y == 0) FALLO("módulo por cero");
+        m[ip->a].i = y == -1 ? 0 : x % y;
+        SIGUIENTE();
+    INSTR(DIVF)
+        if (m[ip->c].f == 0.0f) FALLO("división por cero");
+        m[ip->a].f = m[ip->b].f / m[ip->c].f;
+        SIGUIENTE();
+    INSTR(POWI)
+        if (m[ip->c].i < 0) FALLO("exponente entero negativo");
+        m[ip->a].i = potencia(m[ip->b].i, m[ip->c].i);
+        SIGUIENTE();
+    INSTR(POWF)  m[ip->a].f = powf(m[ip->b].f, m[ip->c].f); SIGUIENTE();
+
+    INSTR(CHSI)  m[ip->a].i = (int)(0u - (unsigned)m[ip->b].i); SIGUIENTE();
+    INSTR(CHSF)  m[ip->a].f = -m[ip->b].f; SIGUIENTE();
+
+    INSTR(CARGA)
+        x = m[ip->c].i;
+        if (!(e = ELEMENTO(ip->b, x))) FALLO("índice fuera de rango");
+        m[ip->a] = *e;
+        SIGUIENTE();
+    INSTR(GUARDA)
+        x = m[ip->b].i;
+        if (!(e = ELEMENTO(ip->a, x))) FALLO("índice fuera de rango");
+        *e = m[ip->c];
+        SIGUIENTE();
+
+    INSTR(IFI_EQ) SI(m[ip->b].i == m[ip->c].i);
+    INSTR(IFI_NE) SI(m[ip->b].i != m[ip->c].i);
+    INSTR(IFI_LT) SI(m[ip->b].i <  m[ip->c].i);
+    INSTR(IFI_LE) SI(m[ip->b].i <= m[ip->c].i);
+    INSTR(IFI_GT) SI(m[ip->b].i >  m[ip->c].i);
+    INSTR(IFI_GE) SI(m[ip->b].i >= m[ip->c].i);
+    INSTR(IFF_EQ) SI(m[ip->b].f == m[ip->c].f);
+    INSTR(IFF_NE) SI(m[ip->b].f != m[ip->c].f);
+    INSTR(IFF_LT) SI(m[ip->b].f <  m[ip->c].f);
+    INSTR(IFF_LE) SI(m[ip->b].f <= m[ip->c].f);
+    INSTR(IFF_GT) SI(m[ip->b].f >  m[ip->c].f);
+    INSTR(IFF_GE) SI(m[ip->b].f >= m[ip->c].f);
+
+    INSTR(GOTO)  SALTAR();
+    INSTR(TABLA)
+        x = m[ip->b].i;
+        if (x < 0 || x >= ip->c) FALLO("índice de la tabla de saltos fuera de rango");
+        ip += 1 + x;
+        DESPACHAR();
+
+    INSTR(PARAM)
+        if (num_params == MAX_PARAMS) FALLO("demasiados PARAM seguidos");
+        params[num_params++] = m[ip->b];
+        SIGUIENTE();
+    INSTR(PUTI)
+        if (ip->c > num_params) FALLO("faltan parámetros en la llamada");
+        for (int k = num_params - ip->c; k < num_params; k++) fprintf(out, "%d\n", params[k].i);
+        num_params -= ip->c;
+        SIGUIENTE();
+    INSTR(PUTF)
+        if (ip->c > num_params) FALLO("faltan parámetros en la llamada");
+        for (int k = num_params - ip->c; k < num_params; k++) fprintf(out, "%g\n", params[k].f);
+        num_params -= ip->c;
+        SIGUIENTE();
+
+    INSTR(SIN_DESTINO) FALLO("salto sin destino");
+    INSTR(HALT) goto fin;
+
+#ifndef VM_HILOS
+    default: FALLO("instrucción desconocida");
+    }
+    }
+#endif
+
+fallo:
+    fflush(out);
+    vm_error((int)(ip - codigo), error);
+fin:
+    for (int k = 0; k < p->num_arrays; k++) free(datos[k]);
+    free(datos);
+    free(m);
+    return error ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+#ifndef VM_H
+#define VM_H
+
+#include <stdio.h>
+#include "perfil.h"
+
+/* Máquina virtual del C3A: ejecuta los quads del buffer de semantica.c
+   (después de las pasadas de optimización y antes de liberarlo). */
+
+typedef struct programa_vm programa_vm;
+
+// Traduce los quads 1..sem_num_quads() a instrucciones de la máquina:
+// variables, temporales y literales pasan a huecos numerados. Devuelve
+// NULL (con el error por stderr) si usa algo que la máquina no conoce.
+programa_vm* vm_cargar();
+
+// Ejecuta desde el quad 1 hasta el HALT; PUTI/PUTF escriben en 'out'.
+// Devuelve 0, o 1 si la ejecución aborta (división por cero, índice
+// fuera de rango...). Se puede ejecutar varias veces. Con 'prf' (o NULL)
+// cada instrucción pasa antes por perf_paso.
+int vm_ejecutar(programa_vm* p, FILE* out, perfil* prf);
+
+void vm_liberar(programa_vm* p);
+
+// Error de ejecución en el quad 'quad': lo entrega la compilación en curso
+// (calculadora.y) a su destino de diagnósticos y a la traza
+void vm_error(int quad, const char* texto);
+
+#endif